@@ -0,0 +1,124 @@
+//
+//  color_converter.cpp
+//  vibes
+//
+//  Created by Justus Stahlhut on 18.10.26.
+//
+
+#include "color_converter.hpp"
+
+extern "C" {
+    #include <libavutil/imgutils.h>
+}
+
+bool ColorConverter::convert(const uint8_t* const src_data[], const int src_linesize[], int width, int height, AVPixelFormat src_fmt, uint8_t* dst_buffer) {
+
+    auto start = std::chrono::steady_clock::now();
+
+    bool converted = convert_frame(src_data, src_linesize, width, height, src_fmt, dst_buffer);
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    stats.frames++;
+    stats.last_ms = elapsed.count();
+    stats.total_ms += elapsed.count();
+
+    return converted;
+}
+
+SwsColorConverter::SwsColorConverter(AVPixelFormat dst_fmt, int threads) : dst_fmt(dst_fmt), threads(threads) {}
+
+SwsColorConverter::~SwsColorConverter() {
+    sws_freeContext(scaler_ctx);
+}
+
+int SwsColorConverter::get_frame_size(int width, int height) {
+    return av_image_get_buffer_size(dst_fmt, width, height, 1);
+}
+
+bool SwsColorConverter::create_scaler(int width, int height, AVPixelFormat src_fmt) {
+
+    sws_freeContext(scaler_ctx);
+
+    scaler_ctx = sws_alloc_context();
+
+    if (!scaler_ctx) {
+        std::cerr << "Could not allocate scaler" << std::endl;
+        return false;
+    }
+
+    av_opt_set_int(scaler_ctx, "srcw", width, 0);
+    av_opt_set_int(scaler_ctx, "srch", height, 0);
+    av_opt_set_int(scaler_ctx, "src_format", src_fmt, 0);
+    av_opt_set_int(scaler_ctx, "dstw", width, 0);
+    av_opt_set_int(scaler_ctx, "dsth", height, 0);
+    av_opt_set_int(scaler_ctx, "dst_format", dst_fmt, 0);
+    av_opt_set_int(scaler_ctx, "sws_flags", SWS_BILINEAR, 0);
+
+    // slice threading, 0 lets swscale pick the number of cores
+    av_opt_set_int(scaler_ctx, "threads", threads, 0);
+
+    if (sws_init_context(scaler_ctx, NULL, NULL) < 0) {
+        std::cerr << "Could not initialize scaler" << std::endl;
+        sws_freeContext(scaler_ctx);
+        scaler_ctx = nullptr;
+        return false;
+    }
+
+    scaler_width = width;
+    scaler_height = height;
+    scaler_fmt = src_fmt;
+
+    return true;
+}
+
+bool SwsColorConverter::convert_frame(const uint8_t* const src_data[], const int src_linesize[], int width, int height, AVPixelFormat src_fmt, uint8_t* dst_buffer) {
+
+    if (!scaler_ctx || width != scaler_width || height != scaler_height || src_fmt != scaler_fmt) {
+        if (!create_scaler(width, height, src_fmt)) {
+            return false;
+        }
+    }
+
+    uint8_t* dst_data[4];
+    int dst_linesize[4];
+
+    if (av_image_fill_arrays(dst_data, dst_linesize, dst_buffer, dst_fmt, width, height, 1) < 0) {
+        std::cerr << "Couldn't fill destination planes" << std::endl;
+        return false;
+    }
+
+    sws_scale(scaler_ctx, src_data, src_linesize, 0, height, dst_data, dst_linesize);
+
+    return true;
+}
+
+PlanarColorConverter::PlanarColorConverter(int threads) : fallback(AV_PIX_FMT_YUV420P, threads) {}
+
+int PlanarColorConverter::get_frame_size(int width, int height) {
+    return av_image_get_buffer_size(AV_PIX_FMT_YUV420P, width, height, 1);
+}
+
+bool PlanarColorConverter::convert_frame(const uint8_t* const src_data[], const int src_linesize[], int width, int height, AVPixelFormat src_fmt, uint8_t* dst_buffer) {
+
+    if (src_fmt != AV_PIX_FMT_YUV420P) {
+        return fallback.convert(src_data, src_linesize, width, height, src_fmt, dst_buffer);
+    }
+
+    uint8_t* dst_data[4];
+    int dst_linesize[4];
+
+    if (av_image_fill_arrays(dst_data, dst_linesize, dst_buffer, AV_PIX_FMT_YUV420P, width, height, 1) < 0) {
+        std::cerr << "Couldn't fill destination planes" << std::endl;
+        return false;
+    }
+
+    int chroma_width = (width + 1) / 2;
+    int chroma_height = (height + 1) / 2;
+
+    av_image_copy_plane(dst_data[0], dst_linesize[0], src_data[0], src_linesize[0], width, height);
+    av_image_copy_plane(dst_data[1], dst_linesize[1], src_data[1], src_linesize[1], chroma_width, chroma_height);
+    av_image_copy_plane(dst_data[2], dst_linesize[2], src_data[2], src_linesize[2], chroma_width, chroma_height);
+
+    return true;
+}
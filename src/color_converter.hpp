@@ -0,0 +1,78 @@
+//
+//  color_converter.hpp
+//  vibes
+//
+//  Created by Justus Stahlhut on 18.10.26.
+//
+
+#ifndef color_converter_hpp
+#define color_converter_hpp
+
+#include <iostream>
+#include <chrono>
+
+extern "C" {
+    #include <libavutil/avutil.h>
+    #include <libavutil/opt.h>
+    #include <libswscale/swscale.h>
+}
+
+struct ConversionStats {
+    int64_t frames = 0;
+    double last_ms = 0;
+    double total_ms = 0;
+
+    double get_average_ms() {
+        return frames == 0 ? 0 : total_ms / frames;
+    }
+};
+
+// converts a decoded picture into the layout the renderer uploads
+class ColorConverter {
+public:
+    virtual ~ColorConverter() {}
+
+    // timed conversion step, dst_buffer has to hold get_frame_size() bytes
+    bool convert(const uint8_t* const src_data[], const int src_linesize[], int width, int height, AVPixelFormat src_fmt, uint8_t* dst_buffer);
+    virtual int get_frame_size(int width, int height) = 0;
+
+    ConversionStats stats;
+protected:
+    virtual bool convert_frame(const uint8_t* const src_data[], const int src_linesize[], int width, int height, AVPixelFormat src_fmt, uint8_t* dst_buffer) = 0;
+};
+
+// swscale based conversion, scaler is only rebuilt if size or format change
+class SwsColorConverter : public ColorConverter {
+public:
+    SwsColorConverter(AVPixelFormat dst_fmt, int threads);
+    ~SwsColorConverter();
+    int get_frame_size(int width, int height) override;
+protected:
+    bool convert_frame(const uint8_t* const src_data[], const int src_linesize[], int width, int height, AVPixelFormat src_fmt, uint8_t* dst_buffer) override;
+private:
+    SwsContext* scaler_ctx = nullptr;
+    AVPixelFormat dst_fmt;
+    int threads;
+
+    // key of the cached scaler
+    int scaler_width = 0;
+    int scaler_height = 0;
+    AVPixelFormat scaler_fmt = AV_PIX_FMT_NONE;
+
+    bool create_scaler(int width, int height, AVPixelFormat src_fmt);
+};
+
+// keeps the picture as YUV 4:2:0, planes packed back to back (Y, U, V)
+// so the GPU can do the color conversion
+class PlanarColorConverter : public ColorConverter {
+public:
+    PlanarColorConverter(int threads);
+    int get_frame_size(int width, int height) override;
+protected:
+    bool convert_frame(const uint8_t* const src_data[], const int src_linesize[], int width, int height, AVPixelFormat src_fmt, uint8_t* dst_buffer) override;
+private:
+    // other source formats are converted to YUV420P by swscale
+    SwsColorConverter fallback;
+};
+
+#endif /* color_converter_hpp */
@@ -0,0 +1,134 @@
+//
+//  frame_pool.cpp
+//  vibes
+//
+//  Created by Justus Stahlhut on 18.10.26.
+//
+
+#include "frame_pool.hpp"
+
+#include <stdexcept>
+#include <utility>
+
+FrameHandle::FrameHandle(FrameHandle&& other) noexcept : pool(other.pool), slot(other.slot), data(other.data) {
+    other.pool = nullptr;
+    other.slot = -1;
+    other.data = nullptr;
+}
+
+FrameHandle& FrameHandle::operator=(FrameHandle&& other) noexcept {
+    
+    if (this == &other) {
+        return *this;
+    }
+    
+    release();
+    
+    pool = std::exchange(other.pool, nullptr);
+    slot = std::exchange(other.slot, -1);
+    data = std::exchange(other.data, nullptr);
+    
+    return *this;
+}
+
+FrameHandle::~FrameHandle() {
+    release();
+}
+
+void FrameHandle::release() {
+    
+    if (pool != nullptr) {
+        pool->release(slot);
+    }
+    
+    pool = nullptr;
+    slot = -1;
+    data = nullptr;
+}
+
+int FrameHandle::take() {
+    
+    int taken_slot = slot;
+    
+    pool = nullptr;
+    slot = -1;
+    data = nullptr;
+    
+    return taken_slot;
+}
+
+FramePool::FramePool(int number_of_frames, size_t frame_size, size_t alignment) : number_of_frames(number_of_frames) {
+    
+    // every slot starts on an aligned address
+    frame_stride = (frame_size + alignment - 1) / alignment * alignment;
+    
+    if (posix_memalign((void**)&slab, alignment, frame_stride * number_of_frames) != 0) {
+        throw std::runtime_error("Couldn't allocate frame pool");
+    }
+    
+    slot_data.resize(number_of_frames);
+    free_slots.reserve(number_of_frames);
+    
+    for (int i=number_of_frames-1; i>=0; i--) {
+        slot_data[i] = slab + i * frame_stride;
+        free_slots.push_back(i);
+    }
+}
+
+FramePool::FramePool(int number_of_frames) : number_of_frames(number_of_frames) {
+    // no slot is free until its memory has been provided
+    slot_data.resize(number_of_frames, nullptr);
+    free_slots.reserve(number_of_frames);
+}
+
+FramePool::~FramePool() {
+    free(slab);
+}
+
+FrameHandle FramePool::acquire() {
+    
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait(lock, [this] { return !free_slots.empty() || closed; });
+    
+    if (closed) {
+        return FrameHandle();
+    }
+    
+    int slot = free_slots.back();
+    free_slots.pop_back();
+    
+    return FrameHandle(this, slot, slot_data[slot]);
+}
+
+void FramePool::provide(int slot, uint8_t* data) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        slot_data[slot] = data;
+        free_slots.push_back(slot);
+    }
+    cv.notify_one();
+}
+
+void FramePool::release(int slot) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        free_slots.push_back(slot);
+    }
+    cv.notify_one();
+}
+
+void FramePool::close() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        closed = true;
+    }
+    cv.notify_all();
+}
+
+int FramePool::get_number_of_frames() {
+    return number_of_frames;
+}
+
+size_t FramePool::get_frame_stride() {
+    return frame_stride;
+}
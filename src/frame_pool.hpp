@@ -0,0 +1,77 @@
+//
+//  frame_pool.hpp
+//  vibes
+//
+//  Created by Justus Stahlhut on 18.10.26.
+//
+
+#ifndef frame_pool_hpp
+#define frame_pool_hpp
+
+#include <stdlib.h>
+#include <cstdint>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+class FramePool;
+
+// owns one pool slot, hands it back to the pool when destroyed
+class FrameHandle {
+public:
+    FrameHandle() {}
+    FrameHandle(FramePool* pool, int slot, uint8_t* data) : pool(pool), slot(slot), data(data) {}
+    FrameHandle(FrameHandle&& other) noexcept;
+    FrameHandle& operator=(FrameHandle&& other) noexcept;
+    ~FrameHandle();
+    
+    FrameHandle(const FrameHandle&) = delete;
+    FrameHandle& operator=(const FrameHandle&) = delete;
+    
+    uint8_t* get_data() { return data; }
+    int get_slot() { return slot; }
+    explicit operator bool() const { return data != nullptr; }
+    
+    void release();
+    // gives up the slot without returning it, the owner has to provide() it again
+    int take();
+private:
+    FramePool* pool = nullptr;
+    int slot = -1;
+    uint8_t* data = nullptr;
+};
+
+// slab of aligned frame buffers, allocated once and recycled
+class FramePool {
+public:
+    FramePool(int number_of_frames, size_t frame_size, size_t alignment);
+    // slots backed by external memory (e.g. mapped PBOs), see provide()
+    FramePool(int number_of_frames);
+    ~FramePool();
+    
+    // blocks until a slot is free, empty handle once the pool is closed
+    FrameHandle acquire();
+    // (re)assigns memory to a slot and marks it free
+    void provide(int slot, uint8_t* data);
+    // wakes a blocked acquire()
+    void close();
+    
+    int get_number_of_frames();
+    size_t get_frame_stride();
+private:
+    friend class FrameHandle;
+    
+    uint8_t* slab = nullptr;
+    const int number_of_frames;
+    size_t frame_stride = 0;
+    std::vector<uint8_t*> slot_data;
+    
+    std::vector<int> free_slots;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool closed = false;
+    
+    void release(int slot);
+};
+
+#endif /* frame_pool_hpp */
@@ -7,7 +7,7 @@
 
 #include "frame_producer.hpp"
 
-FrameProducer::FrameProducer(const char* video_path, const int number_of_devices, const char* position_path, const int frames_in_buffer): number_of_devices(number_of_devices), frames_in_buffer(frames_in_buffer) {
+FrameProducer::FrameProducer(const char* video_path, const WallLayout layout, const char* position_path, const int frames_in_buffer, ReaderConfig reader_config, UploadMode upload_mode): layout(layout), frames_in_buffer(frames_in_buffer), frame_ring(2 * frames_in_buffer) {
     
     std::ifstream file_stream;
     file_stream.exceptions (std::ifstream::failbit | std::ifstream::badbit);
@@ -25,70 +25,92 @@ FrameProducer::FrameProducer(const char* video_path, const int number_of_devices
         std::cerr << "Failed to read position file: " << e.what() << std::endl;
     }
     
+    video_ctx.layout = layout;
+    video_ctx.config = reader_config;
+    
     // open video reader and create context
     if (!open_video_reader(video_path, &video_ctx)) {
         throw std::runtime_error("Couldn't open video reader");
     }
+    
+    if (upload_mode == UPLOAD_MAPPED_PBO) {
+        // one slot per PBO of the render loop
+        frame_pool = new FramePool(frames_in_buffer);
+        // a slot is reclaimed from the GPU only once the render loop runs, don't wait for the last one
+        primed_frames = frames_in_buffer - 1;
+    } else {
+        // ring slots plus the frame being decoded and the one being rendered
+        frame_pool = new FramePool(static_cast<int>(frame_ring.get_capacity()) + 2, video_ctx.rgb_frame_size, ALIGNMENT);
+        primed_frames = frames_in_buffer;
+    }
 }
 
 FrameProducer::~FrameProducer() {
-    close_reader(&video_ctx);
+    // stop decoding before the reader (and its demux thread) goes away
     shutdown_thread();
+    close_reader(&video_ctx);
+    
+    // return frames that never got rendered before the pool goes away
+    FrameSlot slot;
+    while (frame_ring.pop(slot)) {
+        slot.frame.release();
+    }
+    
+    delete frame_pool;
 }
 
 void FrameProducer::buffer_frames() {
     
-    uint8_t* buffer;
     int64_t pts;
     
-    if (posix_memalign((void**)&buffer, ALIGNMENT, video_ctx.rgb_frame_size) != 0) {
-        std::cout << "Couldn't align buffer" << std::endl;
-    }
-    
-    while (!video_ctx.end_of_file && !pending_thread_close) {
-        if (frame_buffer.size() < 2 * frames_in_buffer) {
-            void* data;
-            
-            if (!read_frame(&video_ctx, buffer, &pts)) {
-                throw std::runtime_error("Couldn't read frame");
-            }
-            
-            if (posix_memalign((void**)&data, ALIGNMENT, video_ctx.rgb_frame_size) != 0) {
-                throw std::runtime_error("Couldn't align frame");
+    while (!pending_thread_close) {
+        
+        // blocks while every slot is in flight
+        FrameHandle frame = frame_pool->acquire();
+        
+        if (!frame) {
+            break;
+        }
+        
+        // convert straight into the pool slot
+        if (!read_frame(&video_ctx, frame.get_data(), &pts)) {
+            if (video_ctx.end_of_file) {
+                break;
             }
-            
-            memcpy(data, buffer, video_ctx.rgb_frame_size);
-            
-            frame_buffer.push_back(data);
-            pts_buffer.push_back(pts);
+            throw std::runtime_error("Couldn't read frame");
+        }
+        
+        // blocks while the ring is full
+        FrameSlot slot = { std::move(frame), pts };
+        if (!frame_ring.push(std::move(slot))) {
+            break;
         }
     }
     
-    free(buffer);
+    // lets produce_frame return false once the ring is drained
+    frame_ring.close();
+    decoding_stopped = true;
 }
 
-bool FrameProducer::produce_frame(void*& data, int64_t*& pts) {
+bool FrameProducer::produce_frame(FrameHandle& frame, int64_t& pts) {
+    
+    FrameSlot slot;
     
     // wait until frame has been created
-    while (frame_buffer.size() == 0) {
-        if (video_ctx.end_of_file) {
-            return false;
-        }
-        continue;
+    if (!frame_ring.pop(slot)) {
+        return false;
     }
     
-    void* temp_data_buffer = *&frame_buffer.front();
-    int64_t* temp_pts_buffer = &pts_buffer.front();
-    
-    frame_buffer.pop_front();
-    pts_buffer.pop_front();
-    
-    data = temp_data_buffer;
-    pts = temp_pts_buffer;
+    frame = std::move(slot.frame);
+    pts = slot.pts;
     
     return true;
 }
 
+void FrameProducer::provide_frame(int slot, uint8_t* data) {
+    frame_pool->provide(slot, data);
+}
+
 void FrameProducer::start_thread() {
     producer = std::thread(&FrameProducer::buffer_frames, this);
 }
@@ -100,10 +122,17 @@ void FrameProducer::join_thread() {
 void FrameProducer::shutdown_thread() {
     if (producer.joinable()) {
         pending_thread_close = true;
+        frame_ring.close();
+        frame_pool->close();
         producer.join();
     }
 }
 
+// the decoder closes the ring when it stops, that ends the wait as well
+void FrameProducer::wait_until_primed() {
+    frame_ring.wait_for_size(primed_frames);
+}
+
 float FrameProducer::get_video_width() {
     return video_ctx.width;
 }
@@ -123,3 +152,16 @@ int FrameProducer::get_timebase_num() {
 int FrameProducer::get_timebase_den() {
     return video_ctx.time_base.den;
 }
+
+int64_t FrameProducer::get_frame_duration_ns() {
+    
+    if (video_ctx.frame_rate.num <= 0 || video_ctx.frame_rate.den <= 0) {
+        return 0;
+    }
+    
+    return (int64_t) video_ctx.frame_rate.den * 1000000000 / video_ctx.frame_rate.num;
+}
+
+ConversionStats FrameProducer::get_conversion_stats() {
+    return video_ctx.converter->stats;
+}
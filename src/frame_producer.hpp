@@ -9,34 +9,57 @@
 #define frame_producer_hpp
 
 #include <stdlib.h>
-#include <deque>
+#include <atomic>
 #include <thread>
 #include <fstream>
 #include <sstream>
 
 #include "video_reader.hpp"
+#include "frame_ring.hpp"
+#include "frame_pool.hpp"
+
+enum UploadMode {
+    // decode into pool memory, the render loop copies into the PBO
+    UPLOAD_COPY,
+    // decode straight into mapped PBOs handed in with provide_frame()
+    UPLOAD_MAPPED_PBO
+};
 
 class FrameProducer {
 public:
-    FrameProducer(const char* video_path, const int number_of_devices, const char* position_path, const int frames_in_buffer);
+    FrameProducer(const char* video_path, const WallLayout layout, const char* position_path, const int frames_in_buffer, ReaderConfig reader_config = ReaderConfig(), UploadMode upload_mode = UPLOAD_COPY);
     ~FrameProducer();
-    bool produce_frame(void*& data, int64_t*& pts);
+    bool produce_frame(FrameHandle& frame, int64_t& pts);
+    void provide_frame(int slot, uint8_t* data);
     void start_thread();
     void join_thread();
     void shutdown_thread();
+    // blocks until the ring holds primed_frames frames or decoding has stopped
+    void wait_until_primed();
     float get_video_width();
     float get_video_height();
     int get_rgb_frame_size();
     int get_timebase_num();
     int get_timebase_den();
+    int64_t get_frame_duration_ns();
+    ConversionStats get_conversion_stats();
 private:
     VideoReaderContext video_ctx;
-    const int number_of_devices;
+    const WallLayout layout;
     const int frames_in_buffer;
-    std::deque<void*> frame_buffer;
-    std::deque<int64_t> pts_buffer;
+    // frames in the ring that count as primed
+    size_t primed_frames;
+    struct FrameSlot {
+        FrameHandle frame;
+        int64_t pts = 0;
+    };
+    
+    // decoder thread -> render thread
+    FrameRing<FrameSlot> frame_ring;
+    FramePool* frame_pool = nullptr;
     std::thread producer;
-    bool pending_thread_close = false;
+    std::atomic<bool> pending_thread_close = false;
+    std::atomic<bool> decoding_stopped = false;
     static constexpr int ALIGNMENT = 128;
     
     void buffer_frames();
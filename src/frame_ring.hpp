@@ -0,0 +1,146 @@
+//
+//  frame_ring.hpp
+//  vibes
+//
+//  Created by Justus Stahlhut on 18.10.26.
+//
+
+#ifndef frame_ring_hpp
+#define frame_ring_hpp
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// fixed capacity single-producer / single-consumer ring
+//
+// indices are published with release / acquire, a full or empty ring blocks
+// on an event counter through std::atomic::wait (a futex on linux) instead of spinning
+template <typename T>
+class FrameRing {
+private:
+    static constexpr size_t CACHE_LINE = 64;
+
+    struct alignas(CACHE_LINE) Slot {
+        T value;
+    };
+
+    const size_t capacity;
+    Slot* slots;
+
+    // written by the producer
+    alignas(CACHE_LINE) std::atomic<size_t> write_index{0};
+    alignas(CACHE_LINE) std::atomic<uint32_t> item_event{0};
+
+    // written by the consumer
+    alignas(CACHE_LINE) std::atomic<size_t> read_index{0};
+    alignas(CACHE_LINE) std::atomic<uint32_t> space_event{0};
+
+    alignas(CACHE_LINE) std::atomic<bool> closed{false};
+
+    static void signal(std::atomic<uint32_t>& event) {
+        event.fetch_add(1, std::memory_order_release);
+        event.notify_all();
+    }
+
+public:
+    FrameRing(size_t capacity) : capacity(capacity) {
+        slots = new Slot[capacity];
+    }
+
+    ~FrameRing() {
+        delete[] slots;
+    }
+
+    FrameRing(const FrameRing&) = delete;
+    FrameRing& operator=(const FrameRing&) = delete;
+
+    // blocks while full, false once the ring has been closed
+    bool push(T&& value) {
+
+        size_t index = write_index.load(std::memory_order_relaxed);
+
+        while (true) {
+            // read the event before checking, so a pop in between wakes the wait
+            uint32_t event = space_event.load(std::memory_order_acquire);
+
+            if (closed.load(std::memory_order_acquire)) {
+                return false;
+            }
+
+            if (index - read_index.load(std::memory_order_acquire) < capacity) {
+                break;
+            }
+
+            space_event.wait(event, std::memory_order_acquire);
+        }
+
+        slots[index % capacity].value = std::move(value);
+        write_index.store(index + 1, std::memory_order_release);
+        signal(item_event);
+
+        return true;
+    }
+
+    // blocks while empty, false once the ring has been closed and drained
+    bool pop(T& value) {
+
+        size_t index = read_index.load(std::memory_order_relaxed);
+
+        while (true) {
+            uint32_t event = item_event.load(std::memory_order_acquire);
+
+            if (write_index.load(std::memory_order_acquire) != index) {
+                break;
+            }
+
+            if (closed.load(std::memory_order_acquire)) {
+                return false;
+            }
+
+            item_event.wait(event, std::memory_order_acquire);
+        }
+
+        value = std::move(slots[index % capacity].value);
+        read_index.store(index + 1, std::memory_order_release);
+        signal(space_event);
+
+        return true;
+    }
+
+    // wakes both sides, pop still returns what has been pushed
+    void close() {
+        closed.store(true, std::memory_order_release);
+        signal(item_event);
+        signal(space_event);
+    }
+
+    // blocks until the ring holds count values, false if it gets closed before
+    bool wait_for_size(size_t count) {
+
+        while (true) {
+            uint32_t event = item_event.load(std::memory_order_acquire);
+
+            if (size() >= count) {
+                return true;
+            }
+
+            if (closed.load(std::memory_order_acquire)) {
+                return false;
+            }
+
+            item_event.wait(event, std::memory_order_acquire);
+        }
+    }
+
+    size_t size() {
+        return write_index.load(std::memory_order_acquire) - read_index.load(std::memory_order_acquire);
+    }
+
+    size_t get_capacity() {
+        return capacity;
+    }
+};
+
+#endif /* frame_ring_hpp */
@@ -4,6 +4,7 @@
 
 #include "shader.h"
 #include "frame_producer.hpp"
+#include "pbo_ring.h"
 
 #ifdef __APPLE__
     #include <OpenGL/gl.h>
@@ -33,6 +34,20 @@ float MONITOR_HEIGHT;
     float VIEWPORT_HEIGHT = 768;
 #endif
 
+#ifdef __APPLE__
+    const char* VIDEO_PATH = "/Users/justus/dev/vibes/assets/video_split.mov";
+    const char* POSITION_PATH = "/Users/justus/dev/vibes/assets/POSITION";
+    const char* DRIFT_PATH = "/Users/justus/dev/vibes/assets/CLOCK_DRIFT";
+    const char* ROSTER_PATH = "/Users/justus/dev/vibes/assets/ROSTER";
+#endif
+
+#ifdef __unix
+    const char* VIDEO_PATH = "../assets/video_split.mov";
+    const char* POSITION_PATH = "../assets/POSITION";
+    const char* DRIFT_PATH = "../assets/CLOCK_DRIFT";
+    const char* ROSTER_PATH = "../assets/ROSTER";
+#endif
+
 void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
     glViewport(0, 0, width, height);
 }
@@ -43,8 +58,8 @@ void process_input(GLFWwindow *window) {
     }
 }
 
-int get_next_aligned_number(int alignment) {    
-    return RGB_FRAME_SIZE + RGB_FRAME_SIZE % alignment;
+int get_next_aligned_number(int alignment) {
+    return (RGB_FRAME_SIZE + alignment - 1) / alignment * alignment;
 }
 
 const char* decode_error(GLenum err) {
@@ -91,10 +106,36 @@ void glfw_error_callback(int error, const char* description) {
 int main(int argc, const char* argv[]) {
     
     if (argc < 2) {
-        throw std::runtime_error("Please add the Number of Devices.");
+        throw std::runtime_error("Please add the wall layout (e.g. 3x3) or the Number of Devices.");
+    }
+    
+    // decode fps per threading setting, to pick one for the content
+    if (std::strcmp(argv[1], "--decode-report") == 0) {
+        short position = argc > 2 ? std::stoi(argv[2]) : 0;
+        WallLayout layout;
+        if (argc > 3 && !WallLayout::parse(argv[3], layout)) {
+            throw std::runtime_error("Invalid wall layout.");
+        }
+        report_decode_fps(VIDEO_PATH, layout, position, 600);
+        return 0;
+    }
+    
+    // messages/sec of the control message receive path
+    if (std::strcmp(argv[1], "--protocol-report") == 0) {
+        report_protocol_rate(argc > 2 ? std::stoi(argv[2]) : 1000000);
+        return 0;
+    }
+    
+    WallLayout WALL_LAYOUT;
+    
+    if (!WallLayout::parse(argv[1], WALL_LAYOUT)) {
+        throw std::runtime_error("Invalid wall layout.");
     }
     
-    const int NUMBER_OF_DEVICES = std::stoi(argv[1]);
+    const int NUMBER_OF_DEVICES = WALL_LAYOUT.get_number_of_positions();
+    
+    // the tic-tac-toe show unless every node is started with --fast-election
+    ElectionStrategy ELECTION = argc > 2 && std::strcmp(argv[2], "--fast-election") == 0 ? ELECTION_LOWEST_ADDRESS : ELECTION_TOURNAMENT;
     float VIDEO_WIDTH, VIDEO_HEIGHT;
 
     // find devices
@@ -103,19 +144,37 @@ int main(int argc, const char* argv[]) {
     std::cout << "Setting Local Address." << std::endl;
     network.set_local_addr();
     std::cout << "\tLocal Address: " << network.get_network_config()->address << std::endl;
-    network.discover_devices();
+    
+    // the roster of the last run skips discovery and the election if every device still confirms it
+    Roster roster;
+    bool is_roster_valid = network.load_roster(ROSTER_PATH, roster) && network.validate_roster(roster);
+    
+    if (!is_roster_valid) {
+        network.discover_devices();
+    }
      
     // frames in PBO
     const int FRAMES_IN_BUFFER = 16;
     
-    // create frame producer and initialize video context
-#ifdef __APPLE__
-    FrameProducer frame_producer = FrameProducer("/Users/justus/dev/vibes/assets/video_split.mov", NUMBER_OF_DEVICES, "/Users/justus/dev/vibes/assets/POSITION", FRAMES_IN_BUFFER);
-#endif
+    // UPLOAD_MAPPED_PBO lets the decoder write into GPU visible memory
+    const UploadMode UPLOAD_MODE = UPLOAD_MAPPED_PBO;
     
-#ifdef __unix
-    FrameProducer frame_producer = FrameProducer("../assets/video_split.mov", NUMBER_OF_DEVICES, "../assets/POSITION", FRAMES_IN_BUFFER);
-#endif
+    ReaderConfig reader_config;
+    // CROP_FILTER_GRAPH keeps the libavfilter path for benchmarking
+    reader_config.crop_mode = CROP_PLANE_OFFSET;
+    // SOURCE_TILE decodes the file written by vibes-tile for this position
+    reader_config.source_mode = SOURCE_TILE;
+    // leave one core to the render thread
+    reader_config.thread_count = 3;
+    reader_config.thread_type = FF_THREAD_FRAME;
+    // OUTPUT_YUV420P uploads the planes and converts to RGB in the fragment shader,
+    // OUTPUT_RGB0 converts on the CPU with swscale
+    reader_config.output_format = OUTPUT_YUV420P;
+    
+    const bool YUV_TEXTURES = reader_config.output_format == OUTPUT_YUV420P;
+    
+    // create frame producer and initialize video context
+    FrameProducer frame_producer = FrameProducer(VIDEO_PATH, WALL_LAYOUT, POSITION_PATH, FRAMES_IN_BUFFER, reader_config, UPLOAD_MODE);
     
     // start producing frames
     frame_producer.start_thread();
@@ -133,6 +192,12 @@ int main(int argc, const char* argv[]) {
     // get the next bigger number of RGBA_FRAME_SIZE in the series x^n where x in 2^i
     int BUFFER_SIZE = get_next_aligned_number(128);
     
+    // 4:2:0 chroma planes follow the luma plane in every frame buffer
+    int CHROMA_WIDTH = ((int) VIDEO_WIDTH + 1) / 2;
+    int CHROMA_HEIGHT = ((int) VIDEO_HEIGHT + 1) / 2;
+    long U_PLANE_OFFSET = (long) VIDEO_WIDTH * (long) VIDEO_HEIGHT;
+    long V_PLANE_OFFSET = U_PLANE_OFFSET + (long) CHROMA_WIDTH * CHROMA_HEIGHT;
+    
     int TIMEBASE_NUM = frame_producer.get_timebase_num();
     int TIMEBASE_DEN = frame_producer.get_timebase_den();
     
@@ -213,11 +278,13 @@ int main(int argc, const char* argv[]) {
 #ifdef __APPLE__
     Shader shader("/Users/justus/dev/vibes/src/shaders/rgb/vertex_shader.vs", "/Users/justus/dev/vibes/src/shaders/rgb/fragment_shader.fs",
                   "/Users/justus/dev/vibes/src/shaders/texture/vertex_shader.vs", "/Users/justus/dev/vibes/src/shaders/texture/fragment_shader.fs");
+    shader.load_yuv_shader("/Users/justus/dev/vibes/src/shaders/texture/vertex_shader.vs", "/Users/justus/dev/vibes/src/shaders/texture/yuv_fragment_shader.fs");
 #endif
     
 #ifdef __unix
     Shader shader("../src/shaders/rgb/vertex_shader_es.vs", "../src/shaders/rgb/fragment_shader_es.fs",
                   "../src/shaders/texture/vertex_shader_es.vs", "../src/shaders/texture/fragment_shader_es.fs");
+    shader.load_yuv_shader("../src/shaders/texture/vertex_shader_es.vs", "../src/shaders/texture/yuv_fragment_shader_es.fs");
 #endif
     
     // change viewPort (renderable area) with window size
@@ -277,7 +344,13 @@ int main(int argc, const char* argv[]) {
     
     // determine master
     SynchronizationHandler sync_handler = SynchronizationHandler(network);
-    std::thread ttt_thread([&sync_handler]() { sync_handler.determine_master(); });
+    std::thread ttt_thread([&sync_handler, &roster, is_roster_valid, ELECTION]() {
+        if (is_roster_valid) {
+            sync_handler.restore_master(roster);
+        } else {
+            sync_handler.determine_master(ELECTION);
+        }
+    });
     
     std::mutex* mtx = &sync_handler.ttt.mtx;
     
@@ -294,7 +367,10 @@ int main(int argc, const char* argv[]) {
     bool winner_determined = false;
     float r,g,b,alpha = 0.0f;
     
-    while (!glfwWindowShouldClose(window)) {
+    // nothing to show without a game
+    bool is_game_shown = !is_roster_valid && ELECTION == ELECTION_TOURNAMENT;
+    
+    while (is_game_shown && !glfwWindowShouldClose(window)) {
         
         process_input(window);
         
@@ -417,33 +493,40 @@ int main(int argc, const char* argv[]) {
     delete[] player_vertices;
     
     sync_handler.set_offset();
-    uint32_t offset = sync_handler.get_offset();
+    int64_t offset = sync_handler.get_offset();
     
-    uint32_t playback_start_time = sync_handler.get_start_time();
-    time_t unix_time = (time_t) playback_start_time;
+    // confirmed, the next start validates it instead of searching
+    network.save_roster(ROSTER_PATH, sync_handler.get_master_addr());
     
-    std::cout << "Playback Start Time: " << std::ctime(&unix_time) << std::endl;
+    // keeps sampling the master during playback, scheduling goes through cluster_now()
+    sync_handler.start_clock_discipline(DRIFT_PATH);
 
     
     // VIDEO RENDER
     
-    // create and bind texture
-    unsigned int texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
+    // create and bind textures, one RGBA texture or one per YUV plane
+    const int NUMBER_OF_TEXTURES = YUV_TEXTURES ? 3 : 1;
     
-    // how to handle overscaling
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    unsigned int textures[3];
+    glGenTextures(NUMBER_OF_TEXTURES, textures);
     
-    // texture filtering
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    for (int i=0; i!=NUMBER_OF_TEXTURES; i++) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        
+        // how to handle overscaling, clamped so linear chroma doesn't pull in the opposite edge
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        
+        // texture filtering, chroma planes are upsampled by the sampler
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, i == 0 ? GL_NEAREST : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, i == 0 ? GL_NEAREST : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    }
     
-    // frame row alignment
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    // frame row alignment, planes are packed without row padding
+    glPixelStorei(GL_UNPACK_ALIGNMENT, YUV_TEXTURES ? 1 : 4);
     
     // create vertex buffer object, which is sent to GPU as a whole
     unsigned int VBO;
@@ -476,50 +559,76 @@ int main(int argc, const char* argv[]) {
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
     
-    unsigned int PBO;
-    glGenBuffers(1, &PBO);
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
-    
-    glBufferData(GL_PIXEL_UNPACK_BUFFER, BUFFER_SIZE * FRAMES_IN_BUFFER, NULL, GL_STREAM_DRAW);
-    
-    // bind texture
-    glBindTexture(GL_TEXTURE_2D, texture);
+    // load textures into OpenGL
+    if (YUV_TEXTURES) {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, textures[0]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, VIDEO_WIDTH, VIDEO_HEIGHT, 0, GL_RED, GL_UNSIGNED_BYTE, 0);
+        
+        for (int i=1; i!=3; i++) {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, CHROMA_WIDTH, CHROMA_HEIGHT, 0, GL_RED, GL_UNSIGNED_BYTE, 0);
+        }
+    } else {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, textures[0]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, VIDEO_WIDTH, VIDEO_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    }
     
-    // load texture into OpenGL
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, VIDEO_WIDTH, VIDEO_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
     if (get_error("glTexImage")) {
         return -1;
     }
     
+    PBORing pbo_ring = PBORing(FRAMES_IN_BUFFER, BUFFER_SIZE);
+    
+    if (UPLOAD_MODE == UPLOAD_MAPPED_PBO) {
+        for (int i=0; i!=FRAMES_IN_BUFFER; i++) {
+            uint8_t* data = pbo_ring.map(i);
+            
+            // the decoder would write through it
+            if (data == nullptr || get_error("glMapBufferRange")) {
+                return -1;
+            }
+            
+            frame_producer.provide_frame(i, data);
+        }
+    }
+    
     glBindVertexArray(VAO);
     
-    shader.use_texture_shader();
+    if (YUV_TEXTURES) {
+        shader.use_yuv_shader();
+        shader.set_int("y_texture", 0);
+        shader.set_int("u_texture", 1);
+        shader.set_int("v_texture", 2);
+    } else {
+        shader.use_texture_shader();
+    }
+    
+    // the master picks the start instant once every node reports primed buffers
+    frame_producer.wait_until_primed();
+    int64_t playback_start_time = sync_handler.get_start_time();
+    
+    std::cout << "Playback Start in " << (playback_start_time - sync_handler.cluster_now()) / 1000000 << "ms" << std::endl;
+    
     /*
      *  Render Loop Parameters
      */
     
     int current_frame = 0;
     
-    bool clear_ghosts = false;
-    
     float start_time, end_time;
     
-    std::deque<int64_t> pts_buffer;
+    // cluster time of pts 0
+    int64_t playback_origin = 0;
+    
+    const int64_t FRAME_DURATION = frame_producer.get_frame_duration_ns();
+    int dropped_frames = 0;
     
     // render loop
     while (!glfwWindowShouldClose(window)) {
         
-        static bool initial_frame = true;
-        
-        if (initial_frame) {
-            /*
-            while ((uint32_t) time(NULL) < playback_start_time) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(10));
-            }
-            */
-            glfwSetTime(0.0);
-        }
-        
         start_time = glfwGetTime();
         
         process_input(window);
@@ -531,71 +640,141 @@ int main(int argc, const char* argv[]) {
             return -1;
         }
         
-        void* frame;
-        int64_t* pts;
+        if (UPLOAD_MODE == UPLOAD_MAPPED_PBO) {
+            // hand slots the GPU has finished reading back to the decoder,
+            // block only if the GPU holds every slot, the decoder would starve otherwise
+            int slot = pbo_ring.reclaim(pbo_ring.get_slots_in_flight() == FRAMES_IN_BUFFER);
+            
+            while (slot != -1) {
+                uint8_t* data = pbo_ring.map(slot);
+                
+                if (data == nullptr) {
+                    get_error("glMapBufferRange");
+                    return -1;
+                }
+                
+                frame_producer.provide_frame(slot, data);
+                slot = pbo_ring.reclaim(false);
+            }
+        }
+        
+        FrameHandle frame;
+        int64_t pts;
         double pt_in_seconds;
+        int slot;
         
-        if (!initial_frame) {
-            if (!frame_producer.produce_frame(frame, pts)) {
-                break;
-            }
-            pts_buffer.push_back(*pts);
+        if (!frame_producer.produce_frame(frame, pts)) {
+            break;
         }
-         
-        if (initial_frame) {
-            
-            glBufferData(GL_PIXEL_UNPACK_BUFFER, BUFFER_SIZE * FRAMES_IN_BUFFER, NULL, GL_STREAM_DRAW);
-            if (get_error("glBufferData")) {
-                return -1;
+        
+        pt_in_seconds = pts * (double) TIMEBASE_NUM / (double) TIMEBASE_DEN;
+        
+        // frame 0 is presented at the agreed start instant
+        if (current_frame == 0) {
+            playback_origin = playback_start_time - (int64_t) (pt_in_seconds * 1e9);
+        } else {
+            // skew measured against the master's swaps, shifting the schedule makes late
+            // nodes drop frames below and early ones hold (repeat) the current frame
+            playback_origin -= sync_handler.take_skew_correction();
+        }
+        
+        // on the disciplined cluster clock, so every node follows the master's drift
+        int64_t presentation_time = playback_origin + (int64_t) (pt_in_seconds * 1e9);
+        int64_t wait_time = presentation_time - sync_handler.cluster_now();
+        
+        // more than a frame behind, drop instead of presenting late
+        if (current_frame != 0 && wait_time < -FRAME_DURATION) {
+            if (UPLOAD_MODE == UPLOAD_MAPPED_PBO) {
+                // slot is still mapped, hand it straight back
+                uint8_t* data = frame.get_data();
+                frame_producer.provide_frame(frame.take(), data);
+            } else {
+                frame.release();
             }
             
-            for (int i=0; i!=FRAMES_IN_BUFFER; i++) {
-                frame_producer.produce_frame(frame, pts);
-                pts_buffer.push_back(*pts);
-                glBufferSubData(GL_PIXEL_UNPACK_BUFFER, BUFFER_SIZE * i, BUFFER_SIZE, frame);
-                free(frame);
-                if (get_error("glBufferSubData")) {
+            dropped_frames++;
+            current_frame++;
+            continue;
+        }
+        
+        if (UPLOAD_MODE == UPLOAD_MAPPED_PBO) {
+            // decoder has written straight into the mapped PBO
+            slot = frame.take();
+            
+            // GL_FALSE leaves the contents undefined, the frame is dropped and the slot mapped again
+            if (!pbo_ring.unmap(slot)) {
+                uint8_t* data = pbo_ring.map(slot);
+                
+                if (data == nullptr) {
+                    get_error("glMapBufferRange");
                     return -1;
                 }
+                
+                frame_producer.provide_frame(slot, data);
+                
+                dropped_frames++;
+                current_frame++;
+                continue;
             }
-            
-            initial_frame = false;
+        } else {
+            // waits on the fence of the slot if the GPU still reads it
+            slot = current_frame % FRAMES_IN_BUFFER;
+            pbo_ring.upload(slot, frame.get_data(), RGB_FRAME_SIZE);
+            frame.release();
         }
         
-        pt_in_seconds = pts_buffer.front() * (double) TIMEBASE_NUM / (double) TIMEBASE_DEN;
-        pts_buffer.pop_front();
+        if (get_error("PBO Upload")) {
+            return -1;
+        }
+        
+        wait_time = presentation_time - sync_handler.cluster_now();
         
-        if (pt_in_seconds > glfwGetTime()) {
-            glfwWaitEventsTimeout(pt_in_seconds - glfwGetTime());
+        if (current_frame != 0 && wait_time > 0) {
+            glfwWaitEventsTimeout(wait_time / 1e9);
         }
         
+        pbo_ring.bind(slot);
+        
+        if (YUV_TEXTURES) {
+            // offsets into the bound PBO, one upload per plane
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, textures[0]);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, VIDEO_WIDTH, VIDEO_HEIGHT, GL_RED, GL_UNSIGNED_BYTE, 0);
+            
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, textures[1]);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, CHROMA_WIDTH, CHROMA_HEIGHT, GL_RED, GL_UNSIGNED_BYTE, (void*) U_PLANE_OFFSET);
+            
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, textures[2]);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, CHROMA_WIDTH, CHROMA_HEIGHT, GL_RED, GL_UNSIGNED_BYTE, (void*) V_PLANE_OFFSET);
+        } else {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, VIDEO_WIDTH, VIDEO_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        }
         
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, VIDEO_WIDTH, VIDEO_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, (void*)(intptr_t)(BUFFER_SIZE * (current_frame % FRAMES_IN_BUFFER)));
         if (get_error("glTexSubImage")) {
             return -1;
         }
         
+        // slot is free again once the texture upload has completed
+        pbo_ring.fence(slot);
+        
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
         if (get_error("glDrawElements")) {
             return -1;
         }
         
-        glfwSwapBuffers(window);
-        glfwPollEvents();
-        
-        if (current_frame == 4) {
-            clear_ghosts = true;
+        if (current_frame == 0) {
+            // spin tail, so the first swap lands on the start instant on every node
+            sync_handler.wait_until(presentation_time);
         }
         
-        if (clear_ghosts) {
-            glBufferSubData(GL_PIXEL_UNPACK_BUFFER, BUFFER_SIZE * ((FRAMES_IN_BUFFER + (current_frame - 4)) % FRAMES_IN_BUFFER), BUFFER_SIZE, frame);
-            free(frame);
-        }
+        glfwSwapBuffers(window);
         
-        glFinish();
-        if(get_error("glFinish")) {
-            return -1;
-        }
+        // compared against the master's swaps to find this node's skew
+        sync_handler.report_swap(current_frame, sync_handler.cluster_now(), FRAME_DURATION);
+        
+        glfwPollEvents();
         
         end_time = glfwGetTime();
         
@@ -611,6 +790,9 @@ int main(int argc, const char* argv[]) {
         std::cout << "\tTime: " << ss.str() << "." << std::setw(6) << std::setfill('0') << t_ym.count() << std::endl;
         std::cout << "\tTPF:  " << (end_time - start_time) * 1000 << "ms" << std::endl;
         std::cout << "\t      " << 1 / (end_time - start_time) << "FPS" << std::endl;
+        ConversionStats conversion_stats = frame_producer.get_conversion_stats();
+        std::cout << "\tDrop: " << dropped_frames << std::endl;
+        std::cout << "\tConv: " << conversion_stats.last_ms << "ms (avg " << conversion_stats.get_average_ms() << "ms)" << std::endl;
         std::cout << "-----------------" << std::endl << std::endl;
         
         current_frame++;
@@ -1,28 +1,39 @@
 
 #include "network.h"
 
-Network::Network(int NUMBER_OF_DEVICES) : net_config(NUMBER_OF_DEVICES), thread_pool(20) {
+static_assert(sizeof(NTPPacket) == NTP_PACKET_SIZE, "NTPPacket has to match the wire size");
+static_assert(sizeof(FrameReport) == NTP_PACKET_SIZE, "FrameReport has to match the wire size");
+
+// fnv-1a over the sorted addresses of the whole wall and the master, the same on every node of
+// the roster, 0 is left for nodes without a confirmed one
+static uint32_t get_roster_digest(in_addr_t local, const Roster& roster) {
     
-    Network::NUMBER_OF_DEVICES = NUMBER_OF_DEVICES;
+    std::vector<uint32_t> addresses;
+    addresses.push_back(ntohl(local));
     
-    RECEIVING_BUFFER = new char*[MSG_BUFFER_SIZE];
-    ACK_BUFFER = new char*[MSG_BUFFER_SIZE];
-    CHLG_BUFFER = new char*[MSG_BUFFER_SIZE];
-    GAME_BUFFER = new char*[MSG_BUFFER_SIZE];
+    for (in_addr_t device : roster.devices) {
+        addresses.push_back(ntohl(device));
+    }
     
-    for (int i=0; i!=MSG_BUFFER_SIZE; i++) {
-        RECEIVING_BUFFER[i] = new char[MESSAGE_SIZE];
-        ACK_BUFFER[i] = new char[MESSAGE_SIZE];
-        CHLG_BUFFER[i] = new char[MESSAGE_SIZE];
-        GAME_BUFFER[i] = new char[MESSAGE_SIZE];
-        
-        
-        std::memset(RECEIVING_BUFFER[i], 0, MESSAGE_SIZE);
-        std::memset(ACK_BUFFER[i], 0, MESSAGE_SIZE);
-        std::memset(CHLG_BUFFER[i], 0, MESSAGE_SIZE);
-        std::memset(GAME_BUFFER[i], 0, MESSAGE_SIZE);
+    std::sort(addresses.begin(), addresses.end());
+    addresses.push_back(ntohl(roster.master));
+    
+    uint32_t digest = 2166136261u;
+    
+    for (uint32_t address : addresses) {
+        for (int i=0; i!=4; i++) {
+            digest ^= (address >> (8 * i)) & 0xFF;
+            digest *= 16777619u;
+        }
     }
     
+    return digest == 0 ? 1 : digest;
+}
+
+Network::Network(int NUMBER_OF_DEVICES) : net_config(NUMBER_OF_DEVICES), reactor(MESSAGE_SIZE), delivery([this](int sckt, sockaddr_in& dest_addr, const Packet& packet) { send_packet(sckt, dest_addr, packet); }) {
+    
+    Network::NUMBER_OF_DEVICES = NUMBER_OF_DEVICES;
+    
     // initialize sockets
     ssdp_sckt = create_udp_socket(SSDP_PORT);
     ack_sckt = create_udp_socket(ACK_PORT);
@@ -50,16 +61,33 @@ Network::Network(int NUMBER_OF_DEVICES) : net_config(NUMBER_OF_DEVICES), thread_
     transmission_thread_active = true;
     transmission_thread = std::thread(&Network::transmission_handler, this);
     
-    ack_thread_active = true;
-    ack_thread = std::thread(&Network::ack_listener, this);
+    // ssdp, disc, chlg and game sockets are added once they are needed
+    reactor.add_socket(ack_sckt, [this](sockaddr_in& src_addr, char* data, ssize_t length, int64_t) { receive_ack(src_addr, data, length); });
+    reactor.add_socket(ntp_sckt, [this](sockaddr_in& src_addr, char* data, ssize_t length, int64_t recv_time) { receive_ntp(src_addr, data, length, recv_time); });
+    reactor.start();
+    delivery.start();
 }
 
 Network::~Network() {
     
-    transmission_thread_active = false;
-    ack_thread_active = false;
-    chlg_thread_active = false;
-    ntp_thread_active = false;
+    {
+        std::lock_guard<std::mutex> lock(sender_mutex);
+        transmission_thread_active = false;
+    }
+    sender_cv.notify_all();
+    
+    ntp_server_active = false;
+    
+    // returns right away, the reactor is woken through its eventfd
+    reactor.stop();
+    delivery.stop();
+    
+    {
+        // releases anyone still waiting for a message
+        std::lock_guard<std::mutex> lock(buffer_mutex);
+        buffer_sequence++;
+    }
+    buffer_cv.notify_all();
     
     close(ssdp_sckt);
     close(ack_sckt);
@@ -72,31 +100,9 @@ Network::~Network() {
         transmission_thread.join();
     }
     
-    if (ack_thread.joinable()) {
-        ack_thread.join();
-    }
-    
-    if (chlg_thread.joinable()) {
-        chlg_thread.join();
-    }
-    
-    if (ntp_thread.joinable()) {
-        ntp_thread.join();
-    }
-    
-    for (int i=0; i!=MSG_BUFFER_SIZE; i++) {
-        delete[] RECEIVING_BUFFER[i];
-        delete[] ACK_BUFFER[i];
-        delete[] CHLG_BUFFER[i];
-        delete[] GAME_BUFFER[i];
+    for (std::deque<Message>& queue : message_buffer) {
+        queue.clear();
     }
-    
-    delete[] RECEIVING_BUFFER;
-    delete[] ACK_BUFFER;
-    delete[] CHLG_BUFFER;
-    delete[] GAME_BUFFER;
-    
-    message_buffer.clear();
 }
 
 int Network::create_udp_socket(int port) {
@@ -124,17 +130,7 @@ int Network::create_udp_socket(int port) {
         exit(1);
     }
     
-    // receive timeout
-    struct timeval timeout;
-    std::memset(&timeout, 0, sizeof(timeout));
-    timeout.tv_sec = 1;
-    timeout.tv_usec = 0;
-    
-    if (setsockopt(sckt, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
-        std::cerr << "Error while setting timeout for port " << port << ": " << strerror(errno) << std::endl;
-        exit(1);
-    }
-    
+    // no receive timeout, the reactor only reads sockets that are ready
     return sckt;
 }
 
@@ -174,853 +170,771 @@ void Network::set_local_addr() {
     }
 }
 
-void Network::split_buffer_message(char *&val1, char *&val2, char* msg) {
-    
-    std::string buffer = std::string(msg);
-    int delimiter_index = static_cast<int>(buffer.find_first_of("::"));
+// copies a parsed message into its ring slot, no allocation
+void Network::append_to_buffer(const MessageHeader& header, std::span<const uint8_t> payload, PacketRing& ring) {
     
-    std::string temp_val1 = buffer.substr(0, delimiter_index);
-    std::string temp_val2 = buffer.substr(delimiter_index+2, buffer.size());
+    std::unique_lock<std::mutex> lock(buffer_mutex);
     
-    size_t val1_size = INET_ADDRSTRLEN > temp_val1.size() ? INET_ADDRSTRLEN : temp_val1.size();
-    size_t val2_size = INET_ADDRSTRLEN > temp_val2.size() ? INET_ADDRSTRLEN : temp_val2.size();
+    Packet& slot = ring.packets[ring.counter];
+    slot.header = header;
+    std::memcpy(slot.payload, payload.data(), payload.size());
     
-    val1 = new char[val1_size];
-    val2 = new char[val2_size];
+    ring.counter = (ring.counter + 1) % PacketRing::CAPACITY;
+    ring.size = std::min(ring.size + 1, PacketRing::CAPACITY);
+    ring.total++;
+    buffer_sequence++;
     
-    std::memcpy(val1, temp_val1.c_str(), val1_size);
-    std::memcpy(val2, temp_val2.c_str(), val2_size);
+    lock.unlock();
+    buffer_cv.notify_all();
 }
 
-void Network::append_to_buffer(char* addr, char* message, char**& buffer, int& counter) {
+// copy of the message in slot index, false past the last message received
+bool Network::read_buffer(PacketRing& ring, int index, Packet& packet) {
+    
+    std::lock_guard<std::mutex> lock(buffer_mutex);
     
-    if (std::strlen(addr) + 2 + std::strlen(message) > MESSAGE_SIZE) {
-        char error_msg[std::strlen(addr) + std::strlen(message) + MESSAGE_SIZE];
-        std::snprintf(error_msg, sizeof(error_msg), "Message too long for Buffer: \n\t%s::%s (%zu + 2 + %zu) \ntoo long for MESSAGE_SIZE=%d.", addr, message, std::strlen(addr), std::strlen(message), MESSAGE_SIZE);
-        throw std::length_error(error_msg);
+    if (index >= ring.size) {
+        return false;
     }
     
-    char* buffer_msg = new char[MESSAGE_SIZE];
-    std::snprintf(buffer_msg, MESSAGE_SIZE, "%s::%s", addr, message);
+    packet = ring.packets[index];
+    return true;
+}
+
+// copy of the message at cursor (counted from the last flush) and advances cursor,
+// messages that have been overwritten already are skipped
+bool Network::read_next(PacketRing& ring, uint64_t& cursor, Packet& packet) {
     
     std::lock_guard<std::mutex> lock(buffer_mutex);
     
-    if (*buffer[counter] != '\0') {
-        delete[] buffer[counter];
-        buffer[counter] = new char[MESSAGE_SIZE];
+    if (cursor >= ring.total) {
+        return false;
     }
     
-    std::memcpy(buffer[counter], buffer_msg, MESSAGE_SIZE);
-    counter = ++counter % MSG_BUFFER_SIZE;
+    cursor = std::max(cursor, ring.total - ring.size);
+    packet = ring.packets[cursor % PacketRing::CAPACITY];
+    cursor++;
+    
+    return true;
+}
+
+void Network::flush_buffer(PacketRing& ring) {
     
-    delete[] buffer_msg;
+    std::lock_guard<std::mutex> lock(buffer_mutex);
+    ring.counter = 0;
+    ring.size = 0;
+    ring.total = 0;
 }
 
-void Network::flush_buffer(char**& buffer, int& counter) {
+uint64_t Network::get_buffer_sequence() {
     
     std::lock_guard<std::mutex> lock(buffer_mutex);
-    for (int i=0; i!=MSG_BUFFER_SIZE; i++) {
-        delete[] buffer[i];
-        buffer[i] = new char[MESSAGE_SIZE];
-        std::memset(buffer[i], 0, MESSAGE_SIZE);
+    return buffer_sequence;
+}
+
+// blocks until something has been appended since sequence was taken, sequence is updated
+void Network::wait_for_buffer(uint64_t& sequence) {
+    
+    std::unique_lock<std::mutex> lock(buffer_mutex);
+    buffer_cv.wait(lock, [this, &sequence] { return buffer_sequence != sequence; });
+    sequence = buffer_sequence;
+}
+
+// false if nothing has been appended until deadline
+bool Network::wait_for_buffer(uint64_t& sequence, std::chrono::steady_clock::time_point deadline) {
+    
+    std::unique_lock<std::mutex> lock(buffer_mutex);
+    
+    if (!buffer_cv.wait_until(lock, deadline, [this, &sequence] { return buffer_sequence != sequence; })) {
+        return false;
     }
     
-    counter = 0;
+    sequence = buffer_sequence;
+    return true;
 }
 
-uint16_t Network::checksum(char* data) {
+// wakes the waiters after a buffer has been changed outside of append_to_buffer()
+void Network::notify_buffer() {
+    
+    {
+        std::lock_guard<std::mutex> lock(buffer_mutex);
+        buffer_sequence++;
+    }
     
-    uint8_t sum1 = 0;
-    uint8_t sum2 = 0;
+    buffer_cv.notify_all();
+}
+
+// validates a datagram from the reactor, messages claiming another sender are dropped
+bool Network::parse_datagram(sockaddr_in& src_addr, char* data, ssize_t length, MessageHeader& header, std::span<const uint8_t>& payload) {
     
-    for (int i=0; i!=std::strlen(data); i++) {
-        sum1 = (sum1 + data[i]) % 255;
-        sum2 = (sum2 + sum1) % 255;
+    if (!parse_packet(std::span<const uint8_t>((const uint8_t*) data, length), header, payload)) {
+        return false;
     }
     
-    return (sum2 << 8) | sum1;
+    return header.sender == src_addr.sin_addr.s_addr;
 }
 
-void Network::ack_listener() {
+void Network::receive_ack(sockaddr_in& src_addr, char* data, ssize_t length) {
     
-    while (ack_thread_active) {
-        
-        char* recv_buffer = new char[MESSAGE_SIZE];
-        std::memset(recv_buffer, 0, MESSAGE_SIZE);
-        
-        sockaddr_in src_addr;
-        std::memset(&src_addr, 0, sizeof(src_addr));
-        socklen_t src_addr_len = sizeof(src_addr);
-        
-        if (recvfrom(ack_sckt, recv_buffer, MESSAGE_SIZE, 0, (struct sockaddr*) &src_addr, &src_addr_len) < 0) {
-            if (errno != 0x23 && errno != 0xB) {
-                std::cerr << "Failed to receive ACK message: " << strerror(errno) << std::endl;
-            }
-            
-            delete[] recv_buffer;
-            continue;
-        }
-        
-        char* addr;
-        char* chksum;
-        
-        split_buffer_message(addr, chksum, recv_buffer);
-        append_to_buffer(addr, chksum, ACK_BUFFER, current_ack_index);
-        
-        delete[] recv_buffer;
-        delete[] addr;
-        delete[] chksum;
+    MessageHeader header;
+    std::span<const uint8_t> payload;
+    
+    if (!parse_datagram(src_addr, data, length, header, payload) || header.type != MSG_ACK || payload.size() != 12) {
+        return;
     }
+    
+    Packet ack;
+    ack.header = header;
+    std::memcpy(ack.payload, payload.data(), payload.size());
+    
+    delivery.acknowledge(header.sender, header.session, ack.get_u32(), ack.get_u64(4));
+}
+
+
+// blocks until the message is acknowledged (true) or given up
+bool Network::wait_for_delivery(const char* addr, uint32_t sequence) {
+    return delivery.wait_for_delivery(inet_addr(addr), sequence);
 }
 
-void Network::ack_handler(Message message) {
+void Network::send_ack(sockaddr_in& src_addr, const MessageHeader& header, uint32_t cumulative, uint64_t selective) {
+    
+    struct sockaddr_in dest_addr;
+    std::memset(&dest_addr, 0, sizeof(dest_addr));
     
-    char* addr = message.addr;
-    char* msg = message.msg;
-    int timeout = message.timeout;
+    dest_addr.sin_family = AF_INET;
+    dest_addr.sin_addr = src_addr.sin_addr;
+    dest_addr.sin_port = htons(ACK_PORT);
     
-    if (!listen_for_ack(addr, msg) && timeout > 0) {
-        int sckt = message.sckt;
-        int port = message.port;
-        
-        send_message(sckt, addr, port, msg, timeout-1);
+    // acknowledges the sender's session, unnumbered itself
+    Packet ack;
+    std::memset(&ack.header, 0, sizeof(ack.header));
+    ack.header.type = MSG_ACK;
+    ack.header.sender = inet_addr(net_config.address);
+    ack.header.session = header.session;
+    set_ack_payload(ack, cumulative, selective);
+    
+    if (!send_packet(ack_sckt, dest_addr, ack)) {
+        std::cerr << "Failed sending ACK for message " << header.sequence << std::endl;
     }
 }
 
-bool Network::listen_for_ack(char* addr, char* msg) {
+bool Network::send_packet(int sckt, sockaddr_in& dest_addr, const Packet& packet) {
+    
+    uint8_t datagram[PACKET_SIZE];
+    size_t size = encode_packet(packet, datagram);
     
-    std::chrono::duration<double> duration{1.5};
+    if (sendto(sckt, datagram, size, 0, (struct sockaddr*) &dest_addr, sizeof(dest_addr)) < 0) {
+        // callers check errno to tell a full buffer from a real error
+        int error = errno;
+        std::cerr << "Error while sending message: " << strerror(error) << std::endl;
+        errno = error;
+        return false;
+    }
     
-    std::chrono::time_point start_time = std::chrono::steady_clock::now();
+    return true;
+}
+
+// drains the queues, control lane first, a batch at a time
+void Network::transmission_handler() {
     
-    int c = 0;
+    std::vector<Message> batch;
+    batch.reserve(MAX_SEND_BATCH);
     
-    uint16_t calc_chksum = checksum(msg);
+    auto has_messages = [this]() {
+        return std::any_of(std::begin(message_buffer), std::end(message_buffer), [](std::deque<Message>& queue) { return !queue.empty(); });
+    };
     
-    while (std::chrono::steady_clock::now() - start_time < duration) {
-        
-        if (*ACK_BUFFER[c] == '\0') {
-            c = 0;
-            std::this_thread::sleep_for(std::chrono::milliseconds(50));
-            continue;
-        }
-        
+    while (true) {
         
-        char* buffer_msg = new char[MESSAGE_SIZE];
         {
-            std::lock_guard<std::mutex> lock(buffer_mutex);
-            std::memcpy(buffer_msg, ACK_BUFFER[c], MESSAGE_SIZE);
+            std::unique_lock<std::mutex> lock(sender_mutex);
+            sender_cv.wait(lock, [this, &has_messages]() { return !transmission_thread_active || has_messages(); });
+            
+            if (!transmission_thread_active) {
+                break;
+            }
+            
+            for (std::deque<Message>& queue : message_buffer) {
+                while (!queue.empty() && batch.size() != MAX_SEND_BATCH) {
+                    batch.push_back(queue.front());
+                    queue.pop_front();
+                }
+            }
         }
         
-        char* recv_addr;
-        char* recv_msg;
+        send_batch(batch);
+        batch.clear();
+    }
+}
+
+// one sendmmsg() per run of messages on the same socket, sendto() per message where there is none
+static bool is_transient_send_error(int error) {
+    return error == EAGAIN || error == EWOULDBLOCK || error == ENOBUFS || error == EINTR;
+}
+
+void Network::send_batch(std::vector<Message>& batch) {
+    
+    // resends are up to the retransmit timer from here on
+    auto on_sent = [this](Message& message) {
+        if (message.packet.header.sequence != 0) {
+            delivery.sent(message.dest_addr.sin_addr.s_addr, message.packet.header.sequence);
+        }
+    };
+    
+    #ifdef __linux__
+        struct mmsghdr headers[MAX_SEND_BATCH];
+        struct iovec iovecs[MAX_SEND_BATCH];
+        uint8_t datagrams[MAX_SEND_BATCH][PACKET_SIZE];
         
-        split_buffer_message(recv_addr, recv_msg, buffer_msg);
+        for (size_t i=0; i!=batch.size(); i++) {
+            
+            iovecs[i].iov_base = datagrams[i];
+            iovecs[i].iov_len = encode_packet(batch[i].packet, datagrams[i]);
+            
+            std::memset(&headers[i], 0, sizeof(headers[i]));
+            headers[i].msg_hdr.msg_name = &batch[i].dest_addr;
+            headers[i].msg_hdr.msg_namelen = sizeof(batch[i].dest_addr);
+            headers[i].msg_hdr.msg_iov = &iovecs[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+        }
         
-        delete[] buffer_msg;
+        size_t first = 0;
+        int retries = 0;
         
-        if (std::strcmp(recv_addr, addr) == 0) {
-            uint16_t chksum = static_cast<uint16_t>(strtoul(recv_msg, nullptr, 10));
+        while (first != batch.size()) {
             
-            if (chksum == calc_chksum) {
-                delete[] recv_addr;
-                delete[] recv_msg;
-                
-                return true;
+            size_t last = first + 1;
+            
+            while (last != batch.size() && batch[last].sckt == batch[first].sckt) {
+                last++;
+            }
+            
+            int sent = sendmmsg(batch[first].sckt, headers + first, (unsigned int) (last - first), 0);
+            
+            // a full socket buffer clears quickly, so back off and send the run again
+            if (sent <= 0 && is_transient_send_error(errno) && retries != MAX_SEND_RETRIES) {
+                retries++;
+                std::this_thread::sleep_for(std::chrono::milliseconds(SEND_RETRY_MS));
+                continue;
             }
+            
+            retries = 0;
+            
+            // the failing message is left to the retransmit timer, the rest of the run goes out with the next call
+            if (sent <= 0) {
+                std::cerr << "Error while sending message: " << strerror(errno) << std::endl;
+                on_sent(batch[first]);
+                first++;
+                continue;
+            }
+            
+            for (size_t i=first; i!=first+sent; i++) {
+                on_sent(batch[i]);
+            }
+            
+            first += sent;
         }
-        
-        c = ++c % MSG_BUFFER_SIZE;
-        
-        delete[] recv_addr;
-        delete[] recv_msg;
-    }
+    #else
+        for (Message& message : batch) {
+            
+            int retries = 0;
+            
+            while (!send_packet(message.sckt, message.dest_addr, message.packet) && is_transient_send_error(errno) && retries != MAX_SEND_RETRIES) {
+                retries++;
+                std::this_thread::sleep_for(std::chrono::milliseconds(SEND_RETRY_MS));
+            }
+            
+            // failed messages are left to the retransmit timer as well
+            on_sent(message);
+        }
+    #endif
+}
+
+uint32_t Network::send_message(int sckt, const char* addr, int port, MessageType type, short timeout) {
+    
+    Packet packet;
+    std::memset(&packet.header, 0, sizeof(packet.header));
+    packet.header.type = type;
     
-    return false;
+    return send_message(sckt, addr, port, packet, timeout);
 }
 
-void Network::send_ack(char* addr, char* msg) {
+// numbers the message and queues it for the transmission thread, returns the sequence number to wait for
+// (0 for unnumbered messages, multicasts are never numbered)
+uint32_t Network::send_message(int sckt, const char* addr, int port, Packet& packet, short timeout) {
+    
+    packet.header.version = PROTOCOL_VERSION;
+    packet.header.sender = inet_addr(net_config.address);
+    packet.header.sequence = 0;
+    packet.header.session = delivery.get_session();
     
     struct sockaddr_in dest_addr;
     std::memset(&dest_addr, 0, sizeof(dest_addr));
     
     dest_addr.sin_family = AF_INET;
     dest_addr.sin_addr.s_addr = inet_addr(addr);
-    dest_addr.sin_port = htons(ACK_PORT);
+    dest_addr.sin_port = htons(port);
     
-    size_t ack_msg_size = INET_ADDRSTRLEN + 2 + sizeof(uint16_t);
-    char* ack_msg = new char[ack_msg_size];
+    if (timeout > 0 && !IN_MULTICAST(ntohl(dest_addr.sin_addr.s_addr))) {
+        delivery.track(sckt, dest_addr, packet, timeout);
+    }
     
-    uint16_t chksum = checksum((char*) msg);
+    enqueue_message({sckt, dest_addr, packet});
     
-    std::snprintf(ack_msg, ack_msg_size, "%s::%d", net_config.address, chksum);
+    return packet.header.sequence;
+}
+
+void Network::enqueue_message(const Message& message) {
     
-    if (sendto(ack_sckt, (void*)(intptr_t) ack_msg, ack_msg_size, 0, (struct sockaddr*) &dest_addr, sizeof(dest_addr)) < 0) {
-        std::cerr << "Failed sending ACK for message: \n\t" << msg << std::endl << "Error: " << strerror(errno) << std::endl;
+    {
+        std::lock_guard<std::mutex> lock(sender_mutex);
+        message_buffer[get_send_lane(message.packet.get_type())].push_back(message);
     }
     
-    delete[] ack_msg;
+    sender_cv.notify_one();
 }
 
-void Network::transmission_handler() {
+// acknowledges a message from the reactor and stores it in ring, duplicates are only acknowledged
+void Network::receive_message(sockaddr_in& src_addr, char* data, ssize_t length, PacketRing& ring) {
     
-    while (transmission_thread_active) {
-        
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        
-        if (message_buffer.size() == 0) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
-            continue;
-        }
-        
-        std::lock_guard<std::mutex> lock(sender_mutex);
-        Message message = message_buffer.front();
-        message_buffer.pop_front();
-        
-        int sckt = message.sckt;
-        char* addr  = message.addr;
-        int port = message.port;
-        char* msg = message.msg;
-        
-        struct sockaddr_in dest_addr;
-        memset(&dest_addr, 0, sizeof(dest_addr));
+    MessageHeader header;
+    std::span<const uint8_t> payload;
+    
+    if (!parse_datagram(src_addr, data, length, header, payload)) {
+        return;
+    }
+    
+    if (header.sequence != 0) {
         
-        dest_addr.sin_family = AF_INET;
-        dest_addr.sin_addr.s_addr = inet_addr(addr);
-        dest_addr.sin_port = htons(port);
+        uint32_t cumulative;
+        uint64_t selective;
         
-        if (sendto(sckt, (void*)(intptr_t) msg, std::strlen(msg), 0, (struct sockaddr*) &dest_addr, sizeof(dest_addr)) < 0) {
-            std::cerr << "Error while sending message: " << strerror(errno) << std::endl;
-            continue;
-        }
+        bool is_new = delivery.accept(header.sender, header.session, header.sequence, header.window_start, cumulative, selective);
+        send_ack(src_addr, header, cumulative, selective);
         
-        if (thread_pool.is_running()) {
-            thread_pool.enqueue_task([this, message]() { ack_handler(message); });
+        if (!is_new) {
+            return;
         }
     }
+    
+    append_to_buffer(header, payload, ring);
 }
 
-void Network::send_message(int sckt, const char* addr, int port, const char* msg, short timeout=5) {
+// searches and pings are answered right away, before the searching node can finish and close its sockets
+void Network::receive_discovery(sockaddr_in& src_addr, char* data, ssize_t length) {
     
-    Message message(sckt, (char*) addr, port, (char*) msg, timeout);
+    MessageHeader header;
+    std::span<const uint8_t> payload;
     
-    std::lock_guard<std::mutex> lock(sender_mutex);
-    message_buffer.push_back(message);
-}
-
-void Network::receive_messages(int sckt, bool& receiving, char**& buffer, int& counter) {
+    if (!parse_datagram(src_addr, data, length, header, payload)) {
+        return;
+    }
+    
+    in_addr_t local = inet_addr(net_config.address);
     
-    while (receiving) {
+    if (header.type == MSG_SEARCH && header.sender != local) {
         
-        char* recv_buffer = new char[MESSAGE_SIZE];
-        memset(recv_buffer, 0, MESSAGE_SIZE);
+        struct sockaddr_in dest_addr;
+        std::memset(&dest_addr, 0, sizeof(dest_addr));
         
-        struct sockaddr_in src_addr;
-        std::memset(&src_addr, 0, sizeof(src_addr));
-        socklen_t src_addr_len = sizeof(src_addr);
+        dest_addr.sin_family = AF_INET;
+        dest_addr.sin_addr = src_addr.sin_addr;
+        dest_addr.sin_port = htons(DISC_PORT);
         
-        if (recvfrom(sckt, recv_buffer, MESSAGE_SIZE, 0, (struct sockaddr*) &src_addr, &src_addr_len) < 0) {
-            if (errno != 0x23 && errno != 0xB) {
-                std::cerr << "Error while receiving message: " << strerror(errno) << std::endl;
-            }
-            delete[] recv_buffer;
-            continue;
-        }
+        Packet buddy;
+        std::memset(&buddy.header, 0, sizeof(buddy.header));
+        buddy.header.version = PROTOCOL_VERSION;
+        buddy.header.type = MSG_BUDDY;
+        buddy.header.sender = local;
+        buddy.header.session = delivery.get_session();
         
-        char* device = new char[INET_ADDRSTRLEN];
-        std::memset(device, 0, INET_ADDRSTRLEN);
-        inet_ntop(AF_INET, &(src_addr.sin_addr), device, INET_ADDRSTRLEN);
+        send_packet(disc_sckt, dest_addr, buddy);
+    }
+    
+    if (header.type == MSG_PING && header.sender != local) {
         
-        send_ack(device, recv_buffer);
-        append_to_buffer(device, recv_buffer, buffer, counter);
+        struct sockaddr_in dest_addr;
+        std::memset(&dest_addr, 0, sizeof(dest_addr));
         
-        delete[] device;
-        delete[] recv_buffer;
+        dest_addr.sin_family = AF_INET;
+        dest_addr.sin_addr = src_addr.sin_addr;
+        dest_addr.sin_port = htons(DISC_PORT);
+        
+        Packet pong;
+        std::memset(&pong.header, 0, sizeof(pong.header));
+        pong.header.version = PROTOCOL_VERSION;
+        pong.header.type = MSG_PONG;
+        pong.header.sender = local;
+        pong.header.session = delivery.get_session();
+        // digest first, a node backing out clears the commit before the digest
+        uint32_t digest = roster_digest;
+        set_roster_payload(pong, digest, roster_committed);
+        
+        send_packet(disc_sckt, dest_addr, pong);
     }
+    
+    append_to_buffer(header, payload, RECEIVING_BUFFER);
 }
 
+// registers the ssdp and disc sockets, they stay registered to answer nodes that come up later
+void Network::listen_for_discovery() {
+    
+    auto receive_discovery = [this](sockaddr_in& src_addr, char* data, ssize_t length, int64_t) { this->receive_discovery(src_addr, data, length); };
+    reactor.add_socket(ssdp_sckt, receive_discovery);
+    reactor.add_socket(disc_sckt, receive_discovery);
+}
+
+// searches with a jittered, doubling interval until NUMBER_OF_DEVICES-1 peers have searched or
+// answered, the discovery sockets keep answering searches of nodes that come up later
 void Network::discover_devices() {
     
-    std::vector<char*> discovered_devices;
+    std::unordered_set<in_addr_t> discovered;
+    std::vector<in_addr_t> discovered_devices;
     
-    char* local_addr = net_config.address;
+    size_t number_of_peers = NUMBER_OF_DEVICES - 1;
     
     std::cout << "Discovering Devices..." << std::endl;
     
-    bool discovering = true;
-    std::thread receive_thread_ssdp(&Network::receive_messages, this, ssdp_sckt, std::ref(discovering), std::ref(RECEIVING_BUFFER), std::ref(current_index));
-    std::thread receive_thread_disc(&Network::receive_messages, this, disc_sckt, std::ref(discovering), std::ref(RECEIVING_BUFFER), std::ref(current_index));
+    listen_for_discovery();
+    
+    // other ssdp traffic (routers, media devices) doesn't parse and never reaches the buffers
+    in_addr_t local = inet_addr(net_config.address);
     
-    const char* message =   "M-SEARCH * HTTP/1.1\r\n"
-                            "HOST: 239.255.255.250:1900\r\n"
-                            "MAN: \"ssdp:notify\"\r\n"
-                            "ST: ssdp:all\r\n"
-                            "MX: 3\r\n"
-                            "\r\n";
+    std::mt19937 random(std::random_device{}());
+    std::uniform_real_distribution<double> jitter(0.5, 1.5);
+    
+    std::chrono::duration<double, std::milli> search_interval(SEARCH_INTERVAL_MS);
+    auto next_search = std::chrono::steady_clock::now();
+    
+    // only messages that arrived since the last round are looked at
+    uint64_t cursor = 0;
+    uint64_t sequence = get_buffer_sequence();
     
     // discovery phase
-    while (discovered_devices.size() != NUMBER_OF_DEVICES-1) {
-        send_message(ssdp_sckt, SSDP_ADDR, SSDP_PORT, message);
+    while (discovered.size() < number_of_peers) {
         
-        int max_index = std::max(current_index, current_ack_index);
-        for (int i=0; i!=max_index; i++) {
-            if (*RECEIVING_BUFFER[i] != '\0') {
-                
-                char* buffer_msg = new char[MESSAGE_SIZE];
-                
-                {
-                    std::lock_guard<std::mutex> lock(buffer_mutex);
-                    std::memcpy(buffer_msg, RECEIVING_BUFFER[i], MESSAGE_SIZE);
-                }
-                
-                char* addr;
-                char* msg;
-                
-                split_buffer_message(addr, msg, buffer_msg);
-                
-                delete[] buffer_msg;
-                
-                if (std::strncmp(addr, SSDP_ADDR, INET_ADDRSTRLEN) != 0 && std::strncmp(addr, local_addr, INET_ADDRSTRLEN) != 0 && std::strncmp(addr, ROUTER_ADDR, INET_ADDRSTRLEN) != 0) {
-                    if ((std::strncmp(msg, "BUDDY", 5) == 0 || std::strncmp(msg, "M-SEARCH *", 10) == 0) && std::find_if(discovered_devices.begin(), discovered_devices.end(), [addr](char* c) {
-                        return std::strncmp(addr, c, INET_ADDRSTRLEN) == 0;
-                    }) == discovered_devices.end()) {
-                        discovered_devices.push_back(addr);
-                    } else {
-                        send_message(disc_sckt, addr, DISC_PORT, "BUDDY");
-                        delete[] addr;
-                    }
-                } else {
-                    delete[] addr;
-                }
-                
-                delete[] msg;
+        auto now = std::chrono::steady_clock::now();
+        
+        if (now >= next_search) {
+            send_message(ssdp_sckt, SSDP_ADDR, SSDP_PORT, MSG_SEARCH, 0);
+            
+            next_search = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(search_interval * jitter(random));
+            search_interval = std::min(search_interval * 2, std::chrono::duration<double, std::milli>(MAX_SEARCH_INTERVAL_MS));
+        }
+        
+        Packet packet;
+        
+        while (read_next(RECEIVING_BUFFER, cursor, packet) && discovered.size() < number_of_peers) {
+            
+            if (packet.header.sender == local) {
+                continue;
             }
             
-            if (*ACK_BUFFER[i] != '\0') {
-                
-                char* buffer_msg = new char[MESSAGE_SIZE];
-                {
-                    std::lock_guard<std::mutex> lock(buffer_mutex);
-                    std::memcpy(buffer_msg, ACK_BUFFER[i], MESSAGE_SIZE);
-                }
-                
-                char* addr;
-                char* msg;
-                
-                split_buffer_message(addr, msg, buffer_msg);
-                
-                delete[] buffer_msg;
-                delete[] msg;
-                
-                if (std::strncmp(addr, SSDP_ADDR, INET_ADDRSTRLEN) != 0 && std::strncmp(addr, local_addr, INET_ADDRSTRLEN) != 0 && std::strncmp(addr, ROUTER_ADDR, INET_ADDRSTRLEN) != 0) {
-                    if (std::find_if(discovered_devices.begin(), discovered_devices.end(), [addr](char* c) {
-                        return std::strncmp(addr, c, INET_ADDRSTRLEN) == 0;
-                    }) == discovered_devices.end()) {
-                        discovered_devices.push_back(addr);
-                        continue;
-                    }
-                }
-                
-                delete[] addr;
+            if ((packet.get_type() == MSG_BUDDY || packet.get_type() == MSG_SEARCH) && discovered.insert(packet.header.sender).second) {
+                discovered_devices.push_back(packet.header.sender);
             }
         }
         
-        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        if (discovered.size() < number_of_peers) {
+            wait_for_buffer(sequence, next_search);
+        }
     }
     
     std::cout << "Finishd Searching." << std::endl;
     
     {
+        // searches that haven't gone out yet
         std::lock_guard<std::mutex> lock(sender_mutex);
-        message_buffer.clear();
+        message_buffer[LANE_DISCOVERY].clear();
     }
     
-    // flush and start up again
-    thread_pool.stop_and_flush_threads();
-    thread_pool.start();
-    
-    discovering = false;
-    
-    receive_thread_ssdp.join();
-    receive_thread_disc.join();
-    close(ssdp_sckt);
-    close(disc_sckt);
-    
     std::cout << "Discovered " << discovered_devices.size() << " devices." << std::endl;
     
+    char addr[INET_ADDRSTRLEN];
+    
     for (int i=0; i!=NUMBER_OF_DEVICES-1; i++) {
-        net_config.add_device(discovered_devices[i]);
+        inet_ntop(AF_INET, &discovered_devices[i], addr, INET_ADDRSTRLEN);
+        net_config.add_device(addr);
         std::cout << "\t" << net_config.devices[i] << std::endl;
-        delete[] discovered_devices[i];
     }
 }
 
-void Network::start_challenge_listener() {
-    chlg_thread_active = true;
-    chlg_thread = std::thread(&Network::receive_messages, this, chlg_sckt, std::ref(chlg_thread_active), std::ref(CHLG_BUFFER), std::ref(current_chlg_index));
-}
-
-char* Network::find_challenger(char**& game_status) {
+// roster written by save_roster(), false if there is none or it doesn't fit this wall
+bool Network::load_roster(const char* path, Roster& roster) {
     
-    /*
-        if game has been announced and no winner yet, wait for announcement
-     */
+    std::ifstream file_stream(path);
+    
+    if (!file_stream) {
+        return false;
+    }
     
-    bool initial = true;
-    bool wait_for_game = false;
+    roster = Roster();
+    std::string key, value;
     
-    while (initial || wait_for_game) {
-        static int game_index = -1;
-        initial = false;
+    while (file_stream >> key >> value) {
         
-        char* player1 = new char[INET_ADDRSTRLEN];
-        char* player2 = new char[INET_ADDRSTRLEN];
-        *player1 = '\0';
-        *player2 = '\0';
+        in_addr_t addr;
         
-        for (int i=0; i!=16; i++) {
-            if (*game_status[i] == '\0') {
-                break;
-            }
-            
-            char* msg_bufffer = new char[MESSAGE_SIZE];
-            
-            {
-                std::lock_guard<std::mutex> lock(buffer_mutex);
-                std::memcpy(msg_bufffer, game_status[i], MESSAGE_SIZE);
-            }
-            
-            char* addr1;
-            char* addr2;
-            char* tmp;
-            char* msg;
-            
-            split_buffer_message(addr1, tmp, msg_bufffer);
-            split_buffer_message(addr2, msg, tmp);
-            
-            if (std::strncmp(msg, "GAME", 4) == 0 && std::strncmp(addr1, net_config.address, INET_ADDRSTRLEN) != 0 && std::strncmp(addr2, net_config.address, INET_ADDRSTRLEN) != 0) {
-                if (*player1 == '\0') {
-                    wait_for_game = true;
-                    std::memcpy(player1, addr1, INET_ADDRSTRLEN);
-                    std::memcpy(player2, addr2, INET_ADDRSTRLEN);
-                } else if (std::strncmp(player1, addr2, INET_ADDRSTRLEN) != 0 && std::strncmp(player2, addr1, INET_ADDRSTRLEN) != 0) {
-                    game_index = i;
-                }
-            }
-            
-            if (wait_for_game) {
-                if ((std::strncmp(player1, addr1, INET_ADDRSTRLEN) == 0 && std::strncmp(player2, addr2, INET_ADDRSTRLEN) == 0)
-                    || (std::strncmp(player1, addr2, INET_ADDRSTRLEN) == 0 && std::strncmp(player2, addr1, INET_ADDRSTRLEN) == 0)) {
-                    if (std::strncmp(msg, "WIN", 3) == 0 || std::strncmp(msg, "LOSE", 4) == 0) {
-                        if (game_index == -1) {
-                            wait_for_game = false;
-                        } else {
-                            i = game_index;
-                        }
-                        
-                        delete[] player1;
-                        delete[] player2;
-                        
-                        player1 = new char[INET_ADDRSTRLEN];
-                        player2 = new char[INET_ADDRSTRLEN];
-                        *player1 = '\0';
-                        *player2 = '\0';
-                    }
-                }
-            }
-            
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-            
-            delete[] msg_bufffer;
-            delete[] addr1;
-            delete[] addr2;
-            delete[] tmp;
-            delete[] msg;
+        if (inet_pton(AF_INET, value.c_str(), &addr) != 1) {
+            std::cerr << "Invalid address in roster file: " << value << std::endl;
+            return false;
         }
         
-        delete[] player1;
-        delete[] player2;
+        if (key == "master") {
+            roster.master = addr;
+        } else if (key == "device") {
+            roster.devices.push_back(addr);
+        }
     }
     
-    char** players = new char*[NUMBER_OF_DEVICES];
-    char** losers = new char*[NUMBER_OF_DEVICES];
+    in_addr_t local = inet_addr(net_config.address);
+    size_t number_of_peers = NUMBER_OF_DEVICES - 1;
     
-    for (int i=0; i!=NUMBER_OF_DEVICES; i++) {
-        players[i] = new char[INET_ADDRSTRLEN];
-        losers[i] = new char[INET_ADDRSTRLEN];
-        
-        std::memset(players[i], 0, INET_ADDRSTRLEN);
-        std::memset(losers[i], 0, INET_ADDRSTRLEN);
+    // the local address may have changed since
+    if (roster.devices.size() != number_of_peers || std::find(roster.devices.begin(), roster.devices.end(), local) != roster.devices.end()) {
+        return false;
+    }
+    
+    return roster.master == local || std::find(roster.devices.begin(), roster.devices.end(), roster.master) != roster.devices.end();
+}
+
+// writes the discovered devices and master to path, pings of restarting nodes are answered with it from now on
+bool Network::save_roster(const char* path, const char* master) {
+    
+    Roster roster;
+    roster.master = inet_addr(master);
+    
+    std::ofstream file_stream(path, std::ofstream::trunc);
+    file_stream << "master " << master << std::endl;
+    
+    for (int i=0; i!=NUMBER_OF_DEVICES-1; i++) {
+        roster.devices.push_back(inet_addr(net_config.devices[i]));
+        file_stream << "device " << net_config.devices[i] << std::endl;
     }
     
-    // populate
-    std::memcpy(players[0], net_config.address, INET_ADDRSTRLEN);
-    for (int i=1; i!=NUMBER_OF_DEVICES; i++) {
-        std::memcpy(players[i], net_config.devices[i-1], INET_ADDRSTRLEN);
+    roster_digest = get_roster_digest(inet_addr(net_config.address), roster);
+    roster_committed = true;
+    
+    if (!file_stream) {
+        std::cerr << "Failed to write roster file: " << path << std::endl;
+        return false;
     }
+    
+    return true;
+}
 
-    int c = 0;
+// pings the uncommitted devices every ROSTER_PING_INTERVAL_MS, a device confirms by answering (or
+// pinging) with the same roster digest, so restarted nodes confirm each other and running ones answer
+// from the roster they saved. once every device has confirmed, the node commits and flags that in its
+// pings and pongs, the roster is taken over when every device has committed as well.
+// a node that hasn't committed gives up after ROSTER_TIMEOUT_MS and answers with 0 again to run discovery.
+// a committed node gives up when a device answers with another digest, which only a node that gave up
+// before committing does, so the nodes agree on the roster as long as every device answers. a device
+// that goes down after confirming never commits, the committed nodes give up after ROSTER_COMMIT_TIMEOUT_MS
+// then, reset their digest and run discovery instead of waiting for it.
+bool Network::validate_roster(const Roster& roster) {
+    
+    std::cout << "Validating Roster..." << std::endl;
+    
+    in_addr_t local = inet_addr(net_config.address);
+    uint32_t digest = get_roster_digest(local, roster);
     
-    for (int i=0; i!=16; i++) {
+    roster_committed = false;
+    roster_digest = digest;
+    listen_for_discovery();
+    
+    std::unordered_set<in_addr_t> confirmed;
+    std::unordered_set<in_addr_t> committed;
+    
+    bool is_committed = false;
+    bool is_backed_out = false;
+    
+    auto now = std::chrono::steady_clock::now();
+    auto deadline = now + std::chrono::milliseconds(ROSTER_TIMEOUT_MS);
+    auto next_ping = now;
+    
+    uint64_t cursor = 0;
+    uint64_t sequence = get_buffer_sequence();
+    
+    while (committed.size() < roster.devices.size() && !is_backed_out && now < deadline) {
         
-        if (*game_status[i] == '\0') {
-            break;
+        if (!is_committed && confirmed.size() == roster.devices.size()) {
+            
+            std::cout << "Roster confirmed, waiting for every device to commit..." << std::endl;
+            
+            is_committed = true;
+            roster_committed = true;
+            deadline = now + std::chrono::milliseconds(ROSTER_COMMIT_TIMEOUT_MS);
+            // the devices learn about the commit right away
+            next_ping = now;
         }
         
-        char* buffer_msg = new char[128];
-        {
-            std::lock_guard<std::mutex> lock(var_mutex);
-            std::memcpy(buffer_msg, game_status[i], 128);
-        }
-        
-        char* winner;
-        char* tmp_msg;
-        char* loser;
-        char* msg;
-        
-        split_buffer_message(winner, tmp_msg, buffer_msg);
-        split_buffer_message(loser, msg, tmp_msg);
-        
-        if (std::strncmp(msg, "WIN", 3) == 0) {
-            bool contains_winner = false;
-            bool contains_loser = false;
+        if (now >= next_ping) {
             
-            for (int j=0; j!=NUMBER_OF_DEVICES; j++) {
-                if (*players[j] == 0) {
-                    break;
-                }
-                
-                if (std::strncmp(players[j], winner, INET_ADDRSTRLEN) == 0) {
-                    contains_winner = true;
-                    break;
-                }
-            }
+            char addr[INET_ADDRSTRLEN];
             
-            for (int j=0; j!=NUMBER_OF_DEVICES; j++) {
-                if (*losers[j] == 0) {
-                    break;
-                }
+            for (in_addr_t device : roster.devices) {
                 
-                if (std::strncmp(losers[j], loser, INET_ADDRSTRLEN) == 0) {
-                    contains_winner = false;
-                    break;
+                if (committed.count(device) != 0) {
+                    continue;
                 }
+                
+                Packet packet;
+                std::memset(&packet.header, 0, sizeof(packet.header));
+                packet.header.type = MSG_PING;
+                set_roster_payload(packet, digest, is_committed);
+                
+                inet_ntop(AF_INET, &device, addr, INET_ADDRSTRLEN);
+                send_message(disc_sckt, addr, DISC_PORT, packet, 0);
             }
             
-            if (!contains_winner) {
-                std::memcpy(players[c], winner, INET_ADDRSTRLEN);
-            }
+            next_ping = now + std::chrono::milliseconds(ROSTER_PING_INTERVAL_MS);
+        }
+        
+        Packet packet;
+        
+        while (read_next(RECEIVING_BUFFER, cursor, packet)) {
             
-            if (!contains_loser) {
-                std::memcpy(losers[c], loser, INET_ADDRSTRLEN);
+            bool is_roster_state = (packet.get_type() == MSG_PING || packet.get_type() == MSG_PONG) && packet.header.length == 2 * sizeof(uint32_t);
+            
+            if (!is_roster_state || std::find(roster.devices.begin(), roster.devices.end(), packet.header.sender) == roster.devices.end()) {
+                continue;
             }
             
-            c++;
-        }
-        
-        delete[] buffer_msg;
-        delete[] winner;
-        delete[] loser;
-        delete[] tmp_msg;
-        delete[] msg;
-    }
-    
-    
-    for (int i=0; i!=NUMBER_OF_DEVICES; i++) {
-        bool contains = false;
-        char* addr = net_config.address;
-        if (i == 0) {
-            addr = net_config.address;
-            for (int j=0; j!=NUMBER_OF_DEVICES; j++) {
-                if (*players[j] == 0 && *losers[j] == 0) {
-                    break;
-                }
+            if (packet.get_u32() == digest) {
                 
-                if (std::strncmp(players[j], addr, INET_ADDRSTRLEN) == 0) {
-                    contains = true;
-                    break;
-                }
-            }
-        } else {
-            addr = net_config.devices[i-1];
-            for (int j=0; j!=NUMBER_OF_DEVICES; j++) {
-                if (*players[j] == 0 && *losers[j] == 0) {
-                    break;
-                }
+                confirmed.insert(packet.header.sender);
                 
-                if (std::strncmp(players[j], addr, INET_ADDRSTRLEN) == 0) {
-                    contains = true;
-                    break;
+                if (packet.get_u32(sizeof(uint32_t)) != 0) {
+                    committed.insert(packet.header.sender);
                 }
+            } else if (is_committed) {
+                
+                char addr[INET_ADDRSTRLEN];
+                inet_ntop(AF_INET, &packet.header.sender, addr, INET_ADDRSTRLEN);
+                std::cerr << "Roster given up by " << addr << " after the commit, falling back to discovery." << std::endl;
+                
+                is_backed_out = true;
             }
         }
         
-        if (!contains) {
-            for (int j=0; j!=NUMBER_OF_DEVICES; j++) {
-                if (*players[j] == 0) {
-                    std::memcpy(players[j], addr, INET_ADDRSTRLEN);
-                }
-            }
+        if (committed.size() < roster.devices.size() && !is_backed_out) {
+            wait_for_buffer(sequence, std::min(next_ping, deadline));
         }
+        
+        now = std::chrono::steady_clock::now();
     }
     
-    // sort out
-    for (int i=0; i!=NUMBER_OF_DEVICES; i++) {
-        if (*losers[i] == '\0') {
-            break;
-        }
-        
-        for (int j=0; j!=NUMBER_OF_DEVICES; j++) {
-            if (std::strncmp(players[j], losers[i], INET_ADDRSTRLEN) == 0) {
-                *players[j] = '\0';
-            }
-        }
+    {
+        // pings that haven't gone out yet
+        std::lock_guard<std::mutex> lock(sender_mutex);
+        message_buffer[LANE_DISCOVERY].clear();
     }
     
-    size_t still_player_size = 0;
-    for (int i=0; i!=NUMBER_OF_DEVICES; i++) {
-        if (*players[i] != '\0') {
-            still_player_size++;
+    if (committed.size() < roster.devices.size()) {
+        
+        std::cout << "Roster outdated, " << confirmed.size() << " of " << roster.devices.size() << " devices confirmed, " << committed.size() << " committed." << std::endl;
+        
+        if (is_committed && !is_backed_out) {
+            std::cerr << "Roster commit timed out, a device went silent after confirming." << std::endl;
         }
+        
+        // the commit goes first, pongs read the digest before it
+        roster_committed = false;
+        roster_digest = 0;
+        return false;
     }
     
-    char** still_player = new char*[still_player_size];
-    c = 0;
+    std::cout << "Roster confirmed." << std::endl;
     
-    for (int i=0; i!=NUMBER_OF_DEVICES; i++) {
-        if (*players[i] != '\0') {
-            still_player[c] = new char[INET_ADDRSTRLEN];
-            std::memcpy(still_player[c], players[i], INET_ADDRSTRLEN);
-            c++;
-        }
+    char addr[INET_ADDRSTRLEN];
+    
+    for (int i=0; i!=NUMBER_OF_DEVICES-1; i++) {
+        inet_ntop(AF_INET, &roster.devices[i], addr, INET_ADDRSTRLEN);
+        net_config.add_device(addr);
+        std::cout << "\t" << net_config.devices[i] << std::endl;
     }
     
-    char* challenger = nullptr;
+    return true;
+}
+
+void Network::start_challenge_listener() {
+    reactor.add_socket(chlg_sckt, [this](sockaddr_in& src_addr, char* data, ssize_t length, int64_t) { receive_challenge(src_addr, data, length); });
+}
+
+// a device still voting after this node has decided may have lost its vote (and the retransmits),
+// its numbered votes are answered with the decided master, unnumbered so the answers aren't answered again
+void Network::receive_challenge(sockaddr_in& src_addr, char* data, ssize_t length) {
     
-    std::function<int(char*)> get_last_int = [](char* c) {
-        std::string s = std::string(c);
-        
-        size_t i = s.find_last_of(".") + 1;
-        
-        int n = std::stoi(s.substr(i, s.size()));
-        
-        return n;
-    };
+    receive_message(src_addr, data, length, CHLG_BUFFER);
     
-    std::function<bool(char*, char*)> lex_compare = [get_last_int](char* c1, char* c2) {
-        int n1 = get_last_int(c1);
-        int n2 = get_last_int(c2);
-
-        return n1 < n2;
-    };
+    in_addr_t master = elected_master;
     
-    while (challenger == nullptr) {
-        
-        // sort and create list of distances
-        std::sort(still_player, still_player + still_player_size, lex_compare);
-        int distances[still_player_size-1];
-        
-        for (int i=0; i!=still_player_size-1; i++) {
-            distances[i] = abs(get_last_int(still_player[i]) - get_last_int(still_player[i+1]));
-        }
-        
-        
-        int my_index = [this, &still_player, &still_player_size]() { for (int i=0; i!=still_player_size; i++) {if (std::strncmp(still_player[i], net_config.address, INET_ADDRSTRLEN) == 0) { return i; }}} ();
-        
-        int nearest_neighbors[still_player_size];
-        
-        // copy nn
-        for (int i=0; i!=still_player_size; i++) {
-            if (i == 0) {
-                nearest_neighbors[i] = i+1;
-            } else if (i == still_player_size-1) {
-                nearest_neighbors[i] = i-1;
-            } else {
-                nearest_neighbors[i] = distances[i-1] < distances[i] ? i-1 : i+1;
-            }
-        }
-        
-        int nn = nearest_neighbors[my_index];
-        if (my_index == nearest_neighbors[nn]) {
-            challenger = new char[INET_ADDRSTRLEN];
-            std::memcpy(challenger, still_player[nn], INET_ADDRSTRLEN);
-        } else {
-            int temp = nearest_neighbors[nn];
-            delete[] still_player[nn];
-            delete[] still_player[temp];
-            
-            still_player[nn] = nullptr;
-            still_player[temp] = nullptr;
-            
-            int new_index = 0;
-            for (int i=0; i!=still_player_size; i++) {
-                if (still_player[i] != nullptr) {
-                    still_player[new_index++] = still_player[i];
-                }
-            }
-            
-            still_player_size -= 2;
-        }
-        
-        if (still_player_size == 1) {
-            return nullptr;
-        }
+    if (master == 0) {
+        return;
     }
     
-    return challenger;
-}
-
-void Network::game_status_listener(char**& game_status, bool& listening) {
+    MessageHeader header;
+    std::span<const uint8_t> payload;
     
-    while (listening) {
-        
-        for (int i=0; i!=MSG_BUFFER_SIZE; i++) {
-            if (*CHLG_BUFFER[i] == '\0') {
-                continue;
-            }
-            
-            char* buffer_msg = new char[MESSAGE_SIZE];
-            
-            {
-                std::lock_guard<std::mutex> lock(buffer_mutex);
-                std::memcpy(buffer_msg, CHLG_BUFFER[i], MESSAGE_SIZE);
-            }
-                
-            char* src_addr;
-            char* temp_msg;
-            char* ref_addr;
-            char* msg;
-            
-            // get source addr (the one that has won or lost)
-            split_buffer_message(src_addr, temp_msg, buffer_msg);
-            
-            // get opponent address
-            split_buffer_message(ref_addr, msg, temp_msg);
-            
-            delete[] src_addr;
-            delete[] temp_msg;
-            delete[] ref_addr;
-            
-            if (std::strncmp(msg, "WIN", 3) == 0 || std::strncmp(msg, "LOSE", 4) == 0 || std::strncmp(msg, "WAIT", 4) == 0 || std::strncmp(msg, "GAME", 4) == 0) {
-            
-                int c = 0;
-                
-                bool contains_status = false;
-                
-                while (*game_status[c] != '\0') {
-                    
-                    if (std::strncmp(game_status[c], buffer_msg, MESSAGE_SIZE) == 0) {
-                        contains_status = true;
-                        break;
-                    } else {
-                        c = ++c % 16;
-                    }
-                    
-                }
-                
-                if (!contains_status) {
-                    std::memcpy(game_status[c], buffer_msg, MESSAGE_SIZE);
-                }
-            }
-            
-            delete[] msg;
-            delete[] buffer_msg;
-        }
+    if (!parse_datagram(src_addr, data, length, header, payload) || header.type != MSG_VOTE || header.sequence == 0) {
+        return;
     }
+    
+    Packet packet;
+    std::memset(&packet.header, 0, sizeof(packet.header));
+    packet.header.type = MSG_VOTE;
+    set_addr_payload(packet, master);
+    
+    char addr[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &header.sender, addr, INET_ADDRSTRLEN);
+    send_message(chlg_sckt, addr, CHLG_PORT, packet, 0);
 }
 
-void Network::listen_for_ready(char* addr, bool& listening) {
+void Network::listen_for_ready(char* addr, uint32_t game_number, bool& listening) {
+    
+    uint64_t sequence = get_buffer_sequence();
 
     while (listening) {
         
-        for (int i=0; i!=MSG_BUFFER_SIZE; i++) {
+        Packet packet;
+        in_addr_t opponent = inet_addr(addr);
             
-            if (*CHLG_BUFFER[i] == '\0') {
-                break;
-            }
-            
-            char* buffer_msg = new char[MESSAGE_SIZE];
-            
-            {
-                std::lock_guard<std::mutex> lock(buffer_mutex);
-                std::memcpy(buffer_msg, CHLG_BUFFER[i], MESSAGE_SIZE);
-            }
-            
-            char* recv_addr;
-            char* msg;
-            
-            split_buffer_message(recv_addr, msg, buffer_msg);
-            
-            delete[] buffer_msg;
-            
-            if (std::strncmp(recv_addr, addr, INET_ADDRSTRLEN) == 0 && std::strncmp(msg, "READY", 5) == 0) {
+        for (int i=0; read_buffer(CHLG_BUFFER, i, packet); i++) {
+            // readies of earlier games against the same opponent stay in the buffer
+            if (packet.header.sender == opponent && packet.get_type() == MSG_READY && packet.header.length == sizeof(uint32_t) && packet.get_u32() == game_number) {
                 listening = false;
-                
-                delete[] recv_addr;
-                delete[] msg;
                 break;
             }
-            
-            delete[] recv_addr;
-            delete[] msg;
         }
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        
+        if (listening) {
+            wait_for_buffer(sequence);
+        }
     }
 }
 
-void Network::wait_until_ready(char *addr) {
+void Network::wait_until_ready(char *addr, uint32_t game_number) {
     
     bool listening = true;
     
-    std::thread ready_listener(&Network::listen_for_ready, this, addr, std::ref(listening));
+    std::thread ready_listener(&Network::listen_for_ready, this, addr, game_number, std::ref(listening));
     
-    send_message(chlg_sckt, addr, CHLG_PORT, "READY");
+    Packet packet;
+    std::memset(&packet.header, 0, sizeof(packet.header));
+    packet.header.type = MSG_READY;
+    set_payload(packet, game_number);
     
-    while (listening && !listen_for_ack(addr, (char*) "READY")) {
-        send_message(chlg_sckt, addr, CHLG_PORT, "READY");
+    uint32_t sequence = send_message(chlg_sckt, addr, CHLG_PORT, packet);
+    
+    while (listening && !wait_for_delivery(addr, sequence)) {
+        sequence = send_message(chlg_sckt, addr, CHLG_PORT, packet);
         std::this_thread::sleep_for(std::chrono::milliseconds(100));
     }
     
     ready_listener.join();
 }
 
-void Network::wait_for_challenge(char**& game_status) {
-    
-    bool challenge_found = false;
-    while (!challenge_found) {
-        for (int i=0; i!=16; i++) {
-            if (*game_status[i] == '\0') {
-                break;
-            }
-            
-            char* msg_buffer = new char[MESSAGE_SIZE];
-            
-            {
-                std::lock_guard<std::mutex> lock(buffer_mutex);
-                std::memcpy(msg_buffer, game_status[i], MESSAGE_SIZE);
-            }
-            
-            char* addr1;
-            char* addr2;
-            char* tmp;
-            char* msg;
-            
-            split_buffer_message(addr1, tmp, msg_buffer);
-            split_buffer_message(addr2, msg, tmp);
-            
-            if (std::strncmp(msg, "WIN", 3) == 0 || std::strncmp(msg, "LOSE", 4) == 0) {
-                challenge_found = true;
-            }
-            
-            delete[] msg_buffer;
-            delete[] addr1;
-            delete[] addr2;
-            delete[] tmp;
-            delete[] msg;
-        }
-    }
-}
-
 void Network::start_game(char* addr) {
     
     std::memset(&game, 0, sizeof(game));
@@ -1033,72 +947,49 @@ void Network::start_game(char* addr) {
     }
     
     game.is_game_live = true;
-    game.game_thread = std::thread(&Network::receive_messages, this, game_sckt, std::ref(game.is_game_live), std::ref(GAME_BUFFER), std::ref(current_game_index));
+    reactor.add_socket(game_sckt, [this](sockaddr_in& src_addr, char* data, ssize_t length, int64_t) { receive_message(src_addr, data, length, GAME_BUFFER); });
     
     // new random seed
     std::srand(static_cast<unsigned int>(std::time(nullptr)));
 }
 
 void Network::flush_game_buffer() {
-    flush_buffer(GAME_BUFFER, current_game_index);
+    flush_buffer(GAME_BUFFER);
 }
 
 short Network::receive_move() {
     
+    uint64_t sequence = get_buffer_sequence();
+    
     while (true) {
-        for (int i=0; i!=MSG_BUFFER_SIZE; i++) {
-            if (*GAME_BUFFER[i] == '\0') {
-                break;
-            }
+        Packet packet;
+        in_addr_t opponent = inet_addr(game.opponent_addr);
             
-            char* buffer_msg = new char[MESSAGE_SIZE];
+        for (int i=0; read_buffer(GAME_BUFFER, i, packet); i++) {
+            if (packet.header.sender == opponent && packet.get_type() == MSG_MOVE) {
+                short move = packet.get_i16();
+                bool new_move = false;
+                short new_move_index = -1;
             
-            {
-                std::lock_guard<std::mutex> lock(buffer_mutex);
-                std::memcpy(buffer_msg, GAME_BUFFER[i], MESSAGE_SIZE);
-            }
-            
-            char* addr;
-            char* msg;
-            
-            split_buffer_message(addr, msg, buffer_msg);
-            
-            delete[] buffer_msg;
-            
-            if (std::strcmp(addr, game.opponent_addr) == 0) {
-                if (std::strncmp("MOVE", msg, 4) == 0) {
-                    short move;
-                    bool new_move = false;
-                    short new_move_index = -1;
-                    
-                    sscanf(msg+5, "%hd", &move);
-                    
-                    for (short j=0; j!=8; j++) {
-                        if (game.played_moves[j] == move) {
-                            break;
-                        } else if (game.played_moves[j] == -1) {
-                            new_move = true;
-                            new_move_index = j;
-                            break;
-                        }
+                for (short j=0; j!=8; j++) {
+                    if (game.played_moves[j] == move) {
+                        break;
+                    } else if (game.played_moves[j] == -1) {
+                        new_move = true;
+                        new_move_index = j;
+                        break;
                     }
+                }
+                
+                if (new_move) {
+                    game.played_moves[new_move_index] = move;
                     
-                    if (new_move) {
-                        delete[] msg;
-                        delete[] addr;
-
-                        game.played_moves[new_move_index] = move;
-                        
-                        return move;
-                    }
+                    return move;
                 }
             }
-            
-            delete[] msg;
-            delete[] addr;
         }
         
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        wait_for_buffer(sequence);
     }
     
     return -1;
@@ -1106,10 +997,12 @@ short Network::receive_move() {
 
 void Network::make_move(short m) {
     
-    char* msg = new char[5 + sizeof(short)];
-    std::snprintf(msg, 5 + sizeof(short), "MOVE %hu", m);
+    Packet packet;
+    std::memset(&packet.header, 0, sizeof(packet.header));
+    packet.header.type = MSG_MOVE;
+    set_payload(packet, (int16_t) m);
     
-    send_message(game_sckt, game.opponent_addr, GAME_PORT, msg);
+    send_message(game_sckt, game.opponent_addr, GAME_PORT, packet);
     
     for (int i=0; i!=8; i++) {
         if (game.played_moves[i] == -1) {
@@ -1119,91 +1012,130 @@ void Network::make_move(short m) {
         game.played_moves[i] = m;
         break;
     }
-    
-    delete[] msg;
 }
 
 void Network::end_game() {
 
     game.is_game_live = false;
-    game.game_thread.join();
+    reactor.remove_socket(game_sckt);
     delete[] game.opponent_addr;
     std::memset(&game, 0, sizeof(game));
-    flush_buffer(GAME_BUFFER, current_game_index);
+    flush_buffer(GAME_BUFFER);
 }
 
-int Network::count_wins(char**& game_status) {
+// seeds the bracket with the sorted addresses of the wall, every node ends up with the same one
+void Network::start_bracket() {
     
-    int wins = 0;
+    bracket_players.clear();
+    bracket_wins.clear();
+    bracket_cursor = 0;
     
-    for (int i=0; i!=16; i++) {
-        if (*game_status[i] == 0) {
-            break;
-        }
-        
-        char* buffer_msg = new char[MESSAGE_SIZE];
+    bracket_players.push_back(inet_addr(net_config.address));
         
-        {
-            std::lock_guard<std::mutex> lock(buffer_mutex);
-            std::memcpy(buffer_msg, game_status[i], MESSAGE_SIZE);
-        }
-        
-        char* addr1;
-        char* addr2;
-        char* tmp_msg;
-        char* msg;
+    for (int i=0; i!=NUMBER_OF_DEVICES-1; i++) {
+        bracket_players.push_back(inet_addr(net_config.devices[i]));
+    }
+    
+    std::sort(bracket_players.begin(), bracket_players.end(), [](in_addr_t a, in_addr_t b) { return ntohl(a) < ntohl(b); });
+    
+    start_challenge_listener();
+}
+
+int Network::get_number_of_rounds() {
+    return bracket_players.size() < 2 ? 0 : (int) std::bit_width(bracket_players.size() - 1);
+}
+    
+int Network::get_bracket_index(in_addr_t player) {
+    
+    auto entry = std::find(bracket_players.begin(), bracket_players.end(), player);
+    
+    if (entry == bracket_players.end()) {
+        return -1;
+    }
+    
+    return (int) (entry - bracket_players.begin());
+}
+            
+// players i and j meet in the round of the highest bit their indices differ in
+void Network::record_win(in_addr_t winner, in_addr_t loser) {
+    
+    int i = get_bracket_index(winner);
+    int j = get_bracket_index(loser);
+    
+    if (i < 0 || j < 0 || i == j) {
+        return;
+    }
+    
+    bracket_wins.insert({i, (int) std::bit_width((unsigned) (i ^ j)) - 1});
+}
+
+// true if player has won every match before round, byes count as won
+bool Network::is_bracket_winner(int player, int round) {
+    
+    for (int r=0; r!=round; r++) {
         
-        split_buffer_message(addr1, tmp_msg, buffer_msg);
-        split_buffer_message(addr2, msg, tmp_msg);
+        size_t sibling = (size_t) (((player >> r) ^ 1) << r);
         
-        if (std::strncmp(msg, "WIN", 3) == 0) {
-            wins++;
+        if (sibling < bracket_players.size() && bracket_wins.count({player, r}) == 0) {
+            return false;
         }
-        
-        delete[] buffer_msg;
-        delete[] addr1;
-        delete[] addr2;
-        delete[] tmp_msg;
-        delete[] msg;
     }
     
-    return wins;
+    return true;
 }
 
-void Network::announce_status(char* addr, const char* status, char**& game_status) {
+// in round r the winners of the groups of 2^r neighbouring players meet the winner of the group
+// next to theirs, a group without neighbour is a bye. returns the opponent (a new string) or
+// nullptr for a bye, blocks until the other group has its winner.
+char* Network::find_opponent(int round) {
     
-    char* local_addr = net_config.address;
-    char** devices = net_config.devices;
+    int local = get_bracket_index(inet_addr(net_config.address));
+    
+    size_t first = (size_t) (((local >> round) ^ 1) << round);
     
-    if (addr == nullptr) {
-        addr = local_addr;
+    if (first >= bracket_players.size()) {
+        return nullptr;
     }
     
-    // addr::addr::status
-    size_t msg_len = INET_ADDRSTRLEN + 2 + std::strlen(status);
-    char* msg = new char[msg_len];
-    std::memset(msg, 0, msg_len);
-
-    std::snprintf(msg, msg_len, "%s::%s", addr, status);
+    size_t last = std::min(first + ((size_t) 1 << round), bracket_players.size());
     
-    for (int i=0; i!=NUMBER_OF_DEVICES-1; i++) {
-        char* dest_addr = devices[i];
-        if (std::strncmp(addr, dest_addr, INET_ADDRSTRLEN) != 0) {
-            send_message(chlg_sckt, dest_addr, CHLG_PORT, msg);
+    uint64_t sequence = get_buffer_sequence();
+    
+    while (true) {
+        
+        Packet packet;
+        
+        while (read_next(CHLG_BUFFER, bracket_cursor, packet)) {
+            if (packet.get_type() == MSG_WIN) {
+                record_win(packet.header.sender, packet.get_addr());
+            }
+        }
+        
+        for (size_t i=first; i!=last; i++) {
+            if (is_bracket_winner((int) i, round)) {
+                char* opponent = new char[INET_ADDRSTRLEN];
+                inet_ntop(AF_INET, &bracket_players[i], opponent, INET_ADDRSTRLEN);
+                return opponent;
+            }
         }
+        
+        wait_for_buffer(sequence);
     }
+}
+
+// every device learns the result, the winner of the neighbouring group finds its next opponent through it
+void Network::announce_win(char* loser) {
     
-    delete[] msg;
+    record_win(inet_addr(net_config.address), inet_addr(loser));
     
-    for (int i=0; i!=16; i++) {
-        if (*game_status[i] == '\0') {
-            size_t own_msg_len = INET_ADDRSTRLEN + 2 + INET_ADDRSTRLEN + 2 + std::strlen(status);
-            char* own_msg = new char[own_msg_len];
-            std::snprintf(own_msg, own_msg_len, "%s::%s::%s", local_addr, addr, status);
-            std::memcpy(game_status[i], own_msg, own_msg_len);
-            delete[] own_msg;
-            break;
-        }
+    for (int i=0; i!=NUMBER_OF_DEVICES-1; i++) {
+        
+        Packet packet;
+        std::memset(&packet.header, 0, sizeof(packet.header));
+        packet.header.type = MSG_WIN;
+        set_addr_payload(packet, inet_addr(loser));
+        
+        send_message(chlg_sckt, net_config.devices[i], CHLG_PORT, packet);
     }
 }
 
@@ -1213,180 +1145,329 @@ void Network::announce_master() {
     
     for (int i=0; i!=NUMBER_OF_DEVICES-1; i++) {
         char* addr = devices[i];
-        send_message(chlg_sckt, addr, CHLG_PORT, "MASTER");
+        send_message(chlg_sckt, addr, CHLG_PORT, MSG_MASTER);
     }
     
     std::cout << "Master: " << net_config.address << std::endl;
 }
 
-void Network::listen_for_master(char*& addr) {
+// every node votes for the lowest address of the wall and takes it once every device's vote is in,
+// one delivery to each device (retransmitted like every control message) and no announcement.
+// nobody is elected on a timeout, the vote goes out again to the devices that haven't voted every
+// ELECTION_TIMEOUT_MS, the election fails if a vote is still missing after ELECTION_ROUND_TIMEOUT_MS.
+// once decided, late votes are answered with the master (see receive_challenge()). votes that differ (the devices discovered different walls) only elect a
+// candidate with a majority of the wall, without one the election fails.
+in_addr_t Network::elect_lowest_address() {
     
-    bool master_announced = false;
+    auto is_lower = [](in_addr_t a, in_addr_t b) { return ntohl(a) < ntohl(b); };
     
-    while (!master_announced) {
-        for (int i=0; i!=MSG_BUFFER_SIZE; i++) {
-            if (*CHLG_BUFFER[i] == '\0') {
-                break;
-            }
-            
-            char* buffer_msg = new char[MESSAGE_SIZE];
+    in_addr_t local = inet_addr(net_config.address);
+    in_addr_t candidate = local;
+    
+    std::unordered_set<in_addr_t> devices;
+    
+    for (int i=0; i!=NUMBER_OF_DEVICES-1; i++) {
+        devices.insert(inet_addr(net_config.devices[i]));
+        candidate = std::min(candidate, inet_addr(net_config.devices[i]), is_lower);
+    }
+    
+    elected_master = 0;
+    start_challenge_listener();
+    
+    std::unordered_map<in_addr_t, in_addr_t> votes;
+    size_t number_of_peers = NUMBER_OF_DEVICES - 1;
+    
+    auto now = std::chrono::steady_clock::now();
+    auto next_vote = now;
+    auto deadline = now + std::chrono::milliseconds(ELECTION_ROUND_TIMEOUT_MS);
+    bool is_first_vote = true;
+    
+    uint64_t cursor = 0;
+    uint64_t sequence = get_buffer_sequence();
+    
+    while (votes.size() < number_of_peers) {
+        
+        if (now >= deadline) {
+            std::cerr << "Election timed out, " << votes.size() << " of " << number_of_peers << " votes in." << std::endl;
+            throw std::runtime_error("Election failed, a device hasn't voted.");
+        }
+        
+        if (now >= next_vote) {
             
-            {
-                std::lock_guard<std::mutex> lock(buffer_mutex);
-                std::memcpy(buffer_msg, CHLG_BUFFER[i], MESSAGE_SIZE);
+            if (!is_first_vote) {
+                std::cerr << "Election stalled, " << votes.size() << " of " << number_of_peers << " votes in, voting again." << std::endl;
             }
             
-            char* recv_addr;
-            char* msg;
-            
-            split_buffer_message(recv_addr, msg, buffer_msg);
+            for (int i=0; i!=NUMBER_OF_DEVICES-1; i++) {
+                
+                if (votes.count(inet_addr(net_config.devices[i])) != 0) {
+                    continue;
+                }
+                
+                Packet packet;
+                std::memset(&packet.header, 0, sizeof(packet.header));
+                packet.header.type = MSG_VOTE;
+                set_addr_payload(packet, candidate);
+                
+                send_message(chlg_sckt, net_config.devices[i], CHLG_PORT, packet);
+            }
             
-            delete[] buffer_msg;
+            is_first_vote = false;
+            next_vote = now + std::chrono::milliseconds(ELECTION_TIMEOUT_MS);
+        }
+        
+        Packet packet;
+        
+        while (read_next(CHLG_BUFFER, cursor, packet)) {
+            if (packet.get_type() == MSG_VOTE && devices.count(packet.header.sender) != 0) {
+                votes[packet.header.sender] = packet.get_addr();
+            }
+        }
+        
+        if (votes.size() < number_of_peers) {
+            wait_for_buffer(sequence, std::min(next_vote, deadline));
+        }
+        
+        now = std::chrono::steady_clock::now();
+    }
+    
+    // the own vote counts as well
+    std::unordered_map<in_addr_t, size_t> tally;
+    tally[candidate]++;
+    
+    for (auto& vote : votes) {
+        tally[vote.second]++;
+    }
+    
+    if (tally[candidate] != number_of_peers + 1) {
+        
+        auto majority = std::max_element(tally.begin(), tally.end(), [](auto& a, auto& b) { return a.second < b.second; });
+        
+        std::cerr << "Election not unanimous, " << tally[candidate] << " of " << number_of_peers + 1 << " votes for the lowest address." << std::endl;
+        
+        if (2 * majority->second <= number_of_peers + 1) {
+            throw std::runtime_error("Election failed, no candidate has a majority.");
+        }
+        
+        candidate = majority->first;
+    }
+    
+    char addr[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &candidate, addr, INET_ADDRSTRLEN);
+    std::cout << "Master: " << addr << std::endl;
+    
+    elected_master = candidate;
+    
+    return candidate;
+}
+
+void Network::listen_for_master(char*& addr) {
+    
+    uint64_t sequence = get_buffer_sequence();
+    
+    bool master_announced = false;
+    
+    while (!master_announced) {
+        Packet packet;
             
-            if (std::strncmp(msg, "MASTER", 6) == 0) {
+        for (int i=0; read_buffer(CHLG_BUFFER, i, packet); i++) {
+            if (packet.get_type() == MSG_MASTER) {
                 master_announced = true;
                 addr = new char[INET_ADDRSTRLEN];
-                std::memcpy(addr, recv_addr, INET_ADDRSTRLEN);
+                inet_ntop(AF_INET, &packet.header.sender, addr, INET_ADDRSTRLEN);
                 break;
             }
         }
         
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (!master_announced) {
+            wait_for_buffer(sequence);
+        }
     }
 }
 
-void Network::start_ntp_server(uint32_t& start_time) {
+void Network::start_ntp_server(std::atomic<int64_t>& start_time) {
     
-    ntp_thread_active = true;
-    ntp_thread = std::thread(&Network::ntp_server, this, std::ref(start_time));
+    ntp_start_time = &start_time;
+    ntp_server_active = true;
 }
 
 void Network::stop_ntp_server() {
-    close(ntp_sckt);
-    ntp_thread.join();
+    ntp_server_active = false;
 }
 
-void Network::ntp_server(uint32_t& start_time) {
+// the master's own buffers are primed
+void Network::report_primed() {
+    ntp_primed = true;
+}
+
+void Network::set_frame_report_handler(std::function<int64_t(int64_t, int64_t)> handler) {
+    frame_report_handler = handler;
+}
+
+// every packet on the ntp socket, requests on the master and answers on the other nodes
+void Network::receive_ntp(sockaddr_in& src_addr, char* data, ssize_t length, int64_t recv_time) {
     
-    while (ntp_thread_active) {
-        
-        NTPPacket packet;
-        std::memset(&packet, 0, NTP_PACKET_SIZE);
-        
-        struct sockaddr_in src_addr;
-        std::memset(&src_addr, 0, sizeof(src_addr));
-        socklen_t src_addr_len = sizeof(src_addr);
+    // t2 or t4, stamped by the kernel on arrival rather than once the reactor gets to it
+    if (length != NTP_PACKET_SIZE) {
+        return;
+    }
+    
+    NTPPacket packet;
+    std::memcpy(&packet, data, NTP_PACKET_SIZE);
+    
+    if (ntp_server_active) {
+        serve_ntp_request(src_addr, packet, recv_time);
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(ntp_response_mutex);
         
-        if (recvfrom(ntp_sckt, &packet, NTP_PACKET_SIZE, 0, (struct sockaddr*) &src_addr, &src_addr_len) < 0) {
-            if (errno != 0x23 && errno != 0xB) {
-                std::cerr << "Error Receiving NTP Request: " << strerror(errno) << std::endl;
-            }
-            continue;
+        // every packet type starts with type and request id, late answers to earlier requests are dropped
+        if (ntohl(packet.request_id) != expected_request_id || packet.type != expected_type || ntp_response_ready) {
+            return;
         }
         
-        if (!packet.time_request) {
-            packet.req_recv_time = htonl((uint32_t) time(NULL) + 2208988800UL);
-            packet.res_trans_time = htonl((uint32_t) time(NULL) + 2208988800UL);
-            
-            if (sendto(ntp_sckt, &packet, NTP_PACKET_SIZE, 0, (struct sockaddr*) &src_addr, src_addr_len) < 0) {
-                std::cerr << "Failed Sending NTP Response≤." << std::endl;
-            }
-        } else {
-            if (start_time == 0) {
-                start_time = (uint32_t) time(NULL) + 5UL;
-                std::cout << "Start Time Determined..." << std::endl;
-            }
-            
-            packet.start_time = htonl(start_time);
-            
-            if (sendto(ntp_sckt, &packet, NTP_PACKET_SIZE, 0, (struct sockaddr*) &src_addr, src_addr_len) < 0) {
-                std::cerr << "Error sending start time: " << strerror(errno) << std::endl;
-            }
-        }
+        std::memcpy(&ntp_response, &packet, NTP_PACKET_SIZE);
+        ntp_response_time = recv_time;
+        ntp_response_ready = true;
     }
+    
+    ntp_response_cv.notify_one();
 }
 
+void Network::serve_ntp_request(sockaddr_in& src_addr, NTPPacket& packet, int64_t recv_time) {
     
-NTPPacket Network::ntp_listener(bool* received=nullptr, bool time_request=false) {
-    NTPPacket packet;
-    
-    std::memset(&packet, 0, NTP_PACKET_SIZE);
-    
-    sockaddr_in src_addr;
-    std::memset(&src_addr, 0, sizeof(src_addr));
+    std::atomic<int64_t>& start_time = *ntp_start_time;
     socklen_t src_addr_len = sizeof(src_addr);
+    size_t number_of_peers = NUMBER_OF_DEVICES - 1;
     
-    while (received == nullptr || !(*received)) {
+    if (packet.type == NTP_TIME_REQUEST) {
+        packet.req_recv_time = hton64(recv_time);
+        packet.res_trans_time = hton64(get_steady_time_ns());
         
-        if (recvfrom(ntp_sckt, &packet, NTP_PACKET_SIZE, 0, (struct sockaddr*) &src_addr, &src_addr_len) < 0) {
-            if (errno != 0x23 && errno != 0xB) {
-                std::cerr << "Error Receiving NTP Response: " << strerror(errno) << std::endl;
-            }
-            continue;
+        if (sendto(ntp_sckt, &packet, NTP_PACKET_SIZE, 0, (struct sockaddr*) &src_addr, src_addr_len) < 0) {
+            std::cerr << "Failed Sending NTP Response." << std::endl;
+        }
+    } else if (packet.type == NTP_START_REQUEST) {
+        if (std::find(primed_devices.begin(), primed_devices.end(), src_addr.sin_addr.s_addr) == primed_devices.end()) {
+            primed_devices.push_back(src_addr.sin_addr.s_addr);
+            std::cout << "Primed: " << inet_ntoa(src_addr.sin_addr) << " (" << primed_devices.size() << "/" << number_of_peers << ")" << std::endl;
         }
         
-        if (time_request) {
-            if (!packet.time_request) {
-                continue;
-            }
+        // start on the master clock (the cluster clock) once every node can play right away
+        if (start_time == 0 && ntp_primed && primed_devices.size() >= number_of_peers) {
+            start_time = recv_time + (int64_t) START_DELAY_MS * 1000000;
+            std::cout << "Start Time Determined..." << std::endl;
         }
         
-        packet.res_recv_time = htonl((uint32_t) time(NULL) + 2208988800UL);
+        packet.start_time = hton64(start_time);
         
-        if (received == nullptr) {
-            received = new bool;
+        if (sendto(ntp_sckt, &packet, NTP_PACKET_SIZE, 0, (struct sockaddr*) &src_addr, src_addr_len) < 0) {
+            std::cerr << "Error sending start time: " << strerror(errno) << std::endl;
+        }
+    } else if (packet.type == NTP_FRAME_REPORT) {
+        FrameReport report;
+        std::memcpy(&report, &packet, NTP_PACKET_SIZE);
+        
+        int64_t skew = 0;
+        
+        if (frame_report_handler) {
+            skew = frame_report_handler(ntoh64(report.frame_index), ntoh64(report.swap_time));
+        }
+        
+        report.skew = hton64(skew);
+        
+        if (sendto(ntp_sckt, &report, NTP_PACKET_SIZE, 0, (struct sockaddr*) &src_addr, src_addr_len) < 0) {
+            std::cerr << "Error sending frame skew: " << strerror(errno) << std::endl;
         }
-        *received = true;
     }
+}
 
-    return packet;
+// the reactor hands over the answer to request_id, set before the request is sent
+void Network::expect_ntp_response(uint32_t request_id, uint8_t type) {
+    
+    std::lock_guard<std::mutex> lock(ntp_response_mutex);
+    expected_request_id = request_id;
+    expected_type = type;
+    ntp_response_ready = false;
 }
 
-NTPPacket Network::request_time(char* addr) {
+// waits up to NTP_TIMEOUT_MS for the expected answer
+bool Network::receive_ntp_response(void* response, int64_t& recv_time) {
     
-    NTPPacket packet;
-    std::memset(&packet, 0, sizeof(packet));
+    std::unique_lock<std::mutex> lock(ntp_response_mutex);
     
-    bool server_available = false;
+    bool received = ntp_response_cv.wait_for(lock, std::chrono::milliseconds(NTP_TIMEOUT_MS), [this] { return ntp_response_ready; });
     
-    std::thread recv_thread([this, &packet, &server_available]() {
-        packet = ntp_listener(&server_available);
-    });
+    if (received) {
+        std::memcpy(response, &ntp_response, NTP_PACKET_SIZE);
+        recv_time = ntp_response_time;
+    }
     
-    while (!server_available) {
-        
-        struct sockaddr_in dest_addr;
-        std::memset(&dest_addr, 0, sizeof(dest_addr));
-        
-        dest_addr.sin_family = AF_INET;
-        dest_addr.sin_port = htons(NTP_PORT);
-        dest_addr.sin_addr.s_addr = inet_addr(addr);
-        
-        packet.req_trans_time = htonl((uint32_t) time(NULL) + 2208988800UL);
-        if (sendto(ntp_sckt, &packet, NTP_PACKET_SIZE, 0, (struct sockaddr*) &dest_addr, sizeof(dest_addr)) < 0) {
-            std::cerr << "Error Requesting NTP: " << strerror(errno) << std::endl;
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-            continue;
-        }
+    // later answers to this request are dropped
+    expected_request_id = 0;
+    ntp_response_ready = false;
+    
+    return received;
+}
+
+// one exchange, the timestamps of packet are in host order afterwards
+bool Network::request_time(char* addr, NTPPacket& packet) {
+    
+    std::lock_guard<std::mutex> lock(ntp_mutex);
+    
+    uint32_t request_id = ++ntp_request_id;
+    
+    std::memset(&packet, 0, NTP_PACKET_SIZE);
+    packet.type = NTP_TIME_REQUEST;
+    packet.request_id = htonl(request_id);
+    
+    struct sockaddr_in dest_addr;
+    std::memset(&dest_addr, 0, sizeof(dest_addr));
+    
+    dest_addr.sin_family = AF_INET;
+    dest_addr.sin_port = htons(NTP_PORT);
+    dest_addr.sin_addr.s_addr = inet_addr(addr);
+    
+    expect_ntp_response(request_id, NTP_TIME_REQUEST);
+    
+    // t1, taken right before the send
+    packet.req_trans_time = hton64(get_steady_time_ns());
+    
+    if (sendto(ntp_sckt, &packet, NTP_PACKET_SIZE, 0, (struct sockaddr*) &dest_addr, sizeof(dest_addr)) < 0) {
+        std::cerr << "Error Requesting NTP: " << strerror(errno) << std::endl;
+        return false;
     }
-    recv_thread.join();
     
-    packet.req_trans_time = ntohl(packet.req_trans_time);
-    packet.req_recv_time = ntohl(packet.req_recv_time);
-    packet.res_trans_time = ntohl(packet.res_trans_time);
-    packet.res_recv_time = ntohl(packet.res_recv_time);
+    int64_t recv_time;
     
-    return packet;
+    if (!receive_ntp_response(&packet, recv_time)) {
+        return false;
+    }
+    
+    packet.req_trans_time = ntoh64(packet.req_trans_time);
+    packet.req_recv_time = ntoh64(packet.req_recv_time);
+    packet.res_trans_time = ntoh64(packet.res_trans_time);
+    packet.res_recv_time = recv_time;
+    
+    return true;
 }
 
-uint32_t Network::request_start_time(char* addr) {
+// reports this node as primed until the master answers with a start time
+int64_t Network::request_start_time(char* addr) {
     
     while (true) {
-
+        
+        std::unique_lock<std::mutex> lock(ntp_mutex);
+        
+        uint32_t request_id = ++ntp_request_id;
+        
         NTPPacket packet;
         std::memset(&packet, 0, NTP_PACKET_SIZE);
         
-        packet.time_request = true;
+        packet.type = NTP_START_REQUEST;
+        packet.request_id = htonl(request_id);
         
         sockaddr_in dest_addr;
         std::memset(&dest_addr, 0, sizeof(dest_addr));
@@ -1395,15 +1476,69 @@ uint32_t Network::request_start_time(char* addr) {
         dest_addr.sin_port = htons(NTP_PORT);
         dest_addr.sin_addr.s_addr = inet_addr(addr);
         
+        expect_ntp_response(request_id, NTP_START_REQUEST);
+        
         if (sendto(ntp_sckt, &packet, NTP_PACKET_SIZE, 0, (struct sockaddr*) &dest_addr, sizeof(dest_addr)) < 0) {
             std::cerr << "Error sending start time: " << strerror(errno) << std::endl;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
             continue;
         }
         
-        packet = ntp_listener(nullptr, true);
+        int64_t recv_time;
+        
+        if (!receive_ntp_response(&packet, recv_time)) {
+            continue;
+        }
         
-        return ntohl(packet.start_time);
+        int64_t start_time = ntoh64(packet.start_time);
+        
+        if (start_time != 0) {
+            return start_time;
+        }
+        
+        // other nodes are still filling their buffers
+        lock.unlock();
+        std::this_thread::sleep_for(std::chrono::milliseconds(START_POLL_MS));
+    }
+}
+
+bool Network::report_frame(char* addr, int64_t frame_index, int64_t swap_time, int64_t& skew) {
+    
+    std::lock_guard<std::mutex> lock(ntp_mutex);
+    
+    uint32_t request_id = ++ntp_request_id;
+    
+    FrameReport report;
+    std::memset(&report, 0, NTP_PACKET_SIZE);
+    
+    report.type = NTP_FRAME_REPORT;
+    report.request_id = htonl(request_id);
+    report.frame_index = hton64(frame_index);
+    report.swap_time = hton64(swap_time);
+    
+    sockaddr_in dest_addr;
+    std::memset(&dest_addr, 0, sizeof(dest_addr));
+    
+    dest_addr.sin_family = AF_INET;
+    dest_addr.sin_port = htons(NTP_PORT);
+    dest_addr.sin_addr.s_addr = inet_addr(addr);
+    
+    expect_ntp_response(request_id, NTP_FRAME_REPORT);
+    
+    if (sendto(ntp_sckt, &report, NTP_PACKET_SIZE, 0, (struct sockaddr*) &dest_addr, sizeof(dest_addr)) < 0) {
+        std::cerr << "Error sending frame report: " << strerror(errno) << std::endl;
+        return false;
     }
+    
+    int64_t recv_time;
+    
+    if (!receive_ntp_response(&report, recv_time)) {
+        return false;
+    }
+    
+    skew = ntoh64(report.skew);
+    
+    return true;
 }
 
 
@@ -1444,19 +1579,19 @@ int Network::get_number_of_devices() {
 }
 
 int Network::get_buffer_size() {
-    return MSG_BUFFER_SIZE;
+    return PacketRing::CAPACITY;
 }
 
 int Network::get_message_size() {
     return MESSAGE_SIZE;
 }
 
-char** Network::get_receiving_buffer() {
-    return RECEIVING_BUFFER;
+PacketRing* Network::get_receiving_buffer() {
+    return &RECEIVING_BUFFER;
 }
 
 int Network::get_current_index() {
-    return current_index;
+    return RECEIVING_BUFFER.counter;
 }
 
 Network::NetworkConfig* Network::get_network_config() {
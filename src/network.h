@@ -21,8 +21,11 @@
 #include <deque>
 #include <condition_variable>
 #include <functional>
-#include <list>
+#include <unordered_set>
 #include <algorithm>
+#include <fstream>
+#include <set>
+#include <bit>
 
 #include <sys/socket.h>
 #include <netinet/ip.h>
@@ -31,153 +34,107 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 
+#include "reactor.hpp"
+#include "protocol.hpp"
+#include "reliable_delivery.hpp"
+
+// encoded just before sending, destination resolved when queued
 struct Message {
     int sckt;
-    char* addr;
-    int port;
-    char* msg;
-    int timeout;
-    
-    Message() : sckt(0), addr(nullptr), port(0), msg(nullptr), timeout(0) {}
-    
-    Message(int sckt, char* addr, int port, char* msg, int timeout) : sckt(sckt), port(port), timeout(timeout) {
-        
-        this->addr = new char[INET_ADDRSTRLEN];
-        std::memcpy(this->addr, addr, INET_ADDRSTRLEN);
-        
-        this->msg = new char[std::strlen(msg)];
-        std::memcpy(this->msg, msg, std::strlen(msg));
-    }
-    
-    Message(const Message& other) : sckt(other.sckt), port(other.port), timeout(other.timeout) {
-        
-        addr = new char[INET_ADDRSTRLEN];
-        std::memcpy(addr, other.addr, INET_ADDRSTRLEN);
-        
-        msg = new char[std::strlen(other.msg)];
-        std::memcpy(msg, other.msg, std::strlen(other.msg));
-    }
-    
-    Message& operator=(Message& other) {
-        
-        if (this == &other) {
-            return *this;
-        }
-        
-        delete[] addr;
-        delete[] msg;
-        
-        sckt = other.sckt;
-        port = other.port;
-        timeout = other.timeout;
-        
-        addr = new char[INET_ADDRSTRLEN];
-        std::memcpy(addr, other.addr, INET_ADDRSTRLEN);
-        
-        msg = new char[std::strlen(other.msg)];
-        std::memcpy(msg, other.msg, std::strlen(other.msg));
-        
-        return *this;
-    }
-    
-    ~Message() {
-        delete[] addr;
-        delete[] msg;
-    }
+    sockaddr_in dest_addr;
+    Packet packet;
 };
 
-struct NTPPacket {
-    bool time_request;
-    char padding;
-    uint32_t req_trans_time;
-    uint32_t req_recv_time;
-    uint32_t res_trans_time;
-    uint32_t res_recv_time;
-    uint32_t start_time;
+// send queues, drained in this order (ntp and acks don't queue, they go out right away)
+enum SendLane : uint8_t {
+    // master announcement and game status, playback waits on them
+    LANE_CONTROL,
+    LANE_GAME,
+    // searches, most of the traffic while nodes come up
+    LANE_DISCOVERY,
+    NUMBER_OF_LANES
 };
 
-class ThreadPool {
-private:
-    size_t number_of_threads;
-    std::vector<std::thread> threads;
-    std::list<std::function<void()>> tasks;
-    std::mutex mutex;
-    std::condition_variable condition;
-    bool stop = false;
-public:
-    ThreadPool(size_t number_of_threads) {
-        ThreadPool::number_of_threads = number_of_threads;
-        start();
-    }
+inline SendLane get_send_lane(MessageType type) {
     
-    ~ThreadPool() {
-        stop_and_flush_threads();
+    switch (type) {
+        case MSG_SEARCH:
+        case MSG_BUDDY:
+        case MSG_PING:
+        case MSG_PONG:
+            return LANE_DISCOVERY;
+        case MSG_READY:
+        case MSG_MOVE:
+            return LANE_GAME;
+        default:
+            return LANE_CONTROL;
     }
+}
+
+// devices and master of the last run that got to playback, addresses in network order
+struct Roster {
+    in_addr_t master = 0;
+    std::vector<in_addr_t> devices;
+};
+
+inline int64_t hton64(int64_t value) {
     
-    void start() {
-        
-        if (!stop) {
-            return;
-        }
-        
-        stop = false;
-        threads.clear();
-        
-        for (int i=0; i!=number_of_threads; i++) {
-            threads.emplace_back([this] {
-                while (true) {
-                    std::function<void()> task;
-                    {
-                        std::unique_lock<std::mutex> lock(mutex);
-                        condition.wait(lock, [this] { return !tasks.empty() || stop; });
-                        
-                        if (stop) {
-                            break;
-                        }
-                        
-                        task = std::move(tasks.front());
-                        tasks.pop_front();
-                    }
-                    task();
-                }
-            });
-        }
+    if (htonl(1) == 1) {
+        return value;
     }
     
-    void enqueue_task(std::function<void()> task) {
-        if (is_running()) {
-            {
-                std::unique_lock<std::mutex> locK(mutex);
-                tasks.push_back(task);
-            }
-            condition.notify_one();
-        }
-    }
+    uint64_t bits = (uint64_t) value;
+    return (int64_t) (((uint64_t) htonl((uint32_t) bits) << 32) | htonl((uint32_t) (bits >> 32)));
+}
+
+inline int64_t ntoh64(int64_t value) {
+    return hton64(value);
+}
+
+enum NTPPacketType : uint8_t {
+    NTP_TIME_REQUEST,
+    // reports the sender's buffers as primed and asks for the start time,
+    // start_time stays 0 until every node is primed
+    NTP_START_REQUEST,
+    // FrameReport
+    NTP_FRAME_REPORT
+};
+
+// t1 req_trans_time (client), t2 req_recv_time (server), t3 res_trans_time (server), t4 res_recv_time (client)
+struct NTPPacket {
+    uint8_t type;
+    char padding[3];
+    // responses echo the id, so late answers to earlier requests can be dropped
+    uint32_t request_id;
+    int64_t req_trans_time;
+    int64_t req_recv_time;
+    int64_t res_trans_time;
+    int64_t res_recv_time;
+    int64_t start_time;
     
-    void stop_and_flush_threads() {
-        {
-            std::unique_lock<std::mutex> lock(mutex);
-            stop = true;
-        }
-        
-        condition.notify_all();
-        for (std::thread& t : threads) {
-            if (t.joinable()) {
-                t.join();
-            }
-        }
-        
-        {
-            std::unique_lock<std::mutex> lock(mutex);
-            tasks.clear();
-        }
+    // server clock minus client clock
+    int64_t get_offset() const {
+        return ((req_recv_time - req_trans_time) + (res_trans_time - res_recv_time)) / 2;
     }
     
-    bool is_running() {
-        return !stop;
+    // round trip without the time spent on the server
+    int64_t get_delay() const {
+        return (res_recv_time - req_trans_time) - (res_trans_time - req_recv_time);
     }
 };
 
+// last swap of a node on the cluster clock, the master answers with the node's skew
+// (positive if the node presents frames later than the master)
+struct FrameReport {
+    uint8_t type;
+    char padding[3];
+    uint32_t request_id;
+    int64_t frame_index;
+    int64_t swap_time;
+    int64_t skew;
+    char reserved[16];
+};
+
 class Network {
 private:
     struct NetworkConfig {
@@ -261,17 +218,35 @@ private:
     };
     
     struct Game {
-        std::thread game_thread;
         char* opponent_addr;
         bool is_game_live;
         short played_moves[9];
     };
     
-    #define NTP_PACKET_SIZE 24
-    #define MSG_BUFFER_SIZE 128
+    #define NTP_PACKET_SIZE 48
+    #define NTP_TIMEOUT_MS 200
+    // lead time of the start instant, covers the answers to every primed node
+    #define START_DELAY_MS 250
+    #define START_POLL_MS 20
+    // first interval between searches, doubled after every search up to MAX_SEARCH_INTERVAL_MS
+    #define SEARCH_INTERVAL_MS 100
+    #define MAX_SEARCH_INTERVAL_MS 3200
+    // a cached roster is given up if a device hasn't confirmed it by then
+    #define ROSTER_TIMEOUT_MS 3000
+    // or, once committed, if a device hasn't committed by then (a device that went down after confirming)
+    #define ROSTER_COMMIT_TIMEOUT_MS (4 * ROSTER_TIMEOUT_MS)
+    #define ROSTER_PING_INTERVAL_MS 100
+    // the vote is sent again to devices that haven't voted by then
+    #define ELECTION_TIMEOUT_MS 2000
+    // the election fails if a device's vote is still missing by then
+    #define ELECTION_ROUND_TIMEOUT_MS (5 * ELECTION_TIMEOUT_MS)
     #define MESSAGE_SIZE 512
+    // datagrams per sendmmsg() call
+    #define MAX_SEND_BATCH 64
+    // backoff before a datagram that hit a full socket buffer is sent again
+    #define SEND_RETRY_MS 1
+    #define MAX_SEND_RETRIES 3
     
-    const char* ROUTER_ADDR = "192.168.2.1";
     const char* SSDP_ADDR = "239.255.255.250";
     const int SSDP_PORT = 1900;
     const int ACK_PORT = 1901;
@@ -289,78 +264,144 @@ private:
     
     int NUMBER_OF_DEVICES;
     
-    std::deque<Message> message_buffer;
+    std::deque<Message> message_buffer[NUMBER_OF_LANES];
     
-    char** RECEIVING_BUFFER;
-    char** ACK_BUFFER;
-    char** CHLG_BUFFER;
-    char** GAME_BUFFER;
-    
-    int current_index = 0;
-    int current_ack_index = 0;
-    int current_chlg_index = 0;
-    int current_game_index = 0;
+    PacketRing RECEIVING_BUFFER;
+    PacketRing CHLG_BUFFER;
+    PacketRing GAME_BUFFER;
     
     std::mutex buffer_mutex;
     std::mutex sender_mutex;
-    std::mutex var_mutex;
+    // wakes the transmission thread on enqueue
+    std::condition_variable sender_cv;
 
+    // bumped with every message appended to a buffer,
+    // consumers wait on buffer_cv for it to change instead of polling
+    uint64_t buffer_sequence = 0;
+    std::condition_variable buffer_cv;
+    
     NetworkConfig net_config;
     
+    // receives on every socket
+    Reactor reactor;
+    // numbers, acknowledges and resends the control messages
+    ReliableDelivery delivery;
+    
     std::thread transmission_thread;
-    std::thread ack_thread;
-    std::thread chlg_thread;
-    std::thread ntp_thread;
     
     bool transmission_thread_active = false;
-    bool ack_thread_active = false;
-    bool chlg_thread_active = false;
-    bool ntp_thread_active = false;
+    // the reactor answers ntp requests instead of handing over responses
+    std::atomic<bool> ntp_server_active = false;
+    // answered to pings, 0 until a roster has been saved or is being validated
+    std::atomic<uint32_t> roster_digest = 0;
+    // every device has confirmed roster_digest, nodes that have seen it only give up if one backs out
+    std::atomic<bool> roster_committed = false;
+    // decided by elect_lowest_address(), votes of devices still electing are answered with it, 0 before
+    std::atomic<in_addr_t> elected_master = 0;
+    std::atomic<int64_t>* ntp_start_time = nullptr;
+    
+    // one exchange at a time on the ntp socket
+    std::mutex ntp_mutex;
+    uint32_t ntp_request_id = 0;
+    
+    // answer the requesting thread waits for, filled by the reactor
+    std::mutex ntp_response_mutex;
+    std::condition_variable ntp_response_cv;
+    uint32_t expected_request_id = 0;
+    uint8_t expected_type = 0;
+    bool ntp_response_ready = false;
+    NTPPacket ntp_response;
+    int64_t ntp_response_time = 0;
+    
+    // start barrier, only touched by the reactor thread apart from ntp_primed
+    std::atomic<bool> ntp_primed = false;
+    std::vector<in_addr_t> primed_devices;
+    
+    // master side of the frame reports, frame index and swap time to skew
+    std::function<int64_t(int64_t, int64_t)> frame_report_handler;
     
     int create_udp_socket(int);
-    void split_buffer_message(char*& addr, char*& msg, char* buffer_msg);
-    void append_to_buffer(char* addr, char* message, char**& buffer, int& counter);
-    void flush_buffer(char**& buffer, int& counter);
-    uint16_t checksum(char* data);
-    void ack_listener();
-    void ack_handler(Message msg);
-    bool listen_for_ack(char* addr, char* msg);
-    void send_ack(char* addr, char* msg);
+    void append_to_buffer(const MessageHeader& header, std::span<const uint8_t> payload, PacketRing& ring);
+    bool read_buffer(PacketRing& ring, int index, Packet& packet);
+    bool read_next(PacketRing& ring, uint64_t& cursor, Packet& packet);
+    void flush_buffer(PacketRing& ring);
+    uint64_t get_buffer_sequence();
+    void wait_for_buffer(uint64_t& sequence);
+    bool wait_for_buffer(uint64_t& sequence, std::chrono::steady_clock::time_point deadline);
+    void notify_buffer();
+    bool parse_datagram(sockaddr_in& src_addr, char* data, ssize_t length, MessageHeader& header, std::span<const uint8_t>& payload);
+    void receive_ack(sockaddr_in& src_addr, char* data, ssize_t length);
+    void send_ack(sockaddr_in& src_addr, const MessageHeader& header, uint32_t cumulative, uint64_t selective);
+    bool wait_for_delivery(const char* addr, uint32_t sequence);
+    bool send_packet(int sckt, sockaddr_in& dest_addr, const Packet& packet);
     void transmission_handler();
-    void send_message(int sckt, const char* addr, int port, const char* msg, short timeout);
-    void receive_messages(int sckt, bool& receiving, char**& buffer, int& counter);
+    void send_batch(std::vector<Message>& batch);
+    // timeout is the number of resends, 0 sends the message unnumbered and unacknowledged
+    uint32_t send_message(int sckt, const char* addr, int port, MessageType type, short timeout = 5);
+    uint32_t send_message(int sckt, const char* addr, int port, Packet& packet, short timeout = 5);
+    void enqueue_message(const Message& message);
+    void receive_message(sockaddr_in& src_addr, char* data, ssize_t length, PacketRing& ring);
+    void receive_discovery(sockaddr_in& src_addr, char* data, ssize_t length);
+    void receive_challenge(sockaddr_in& src_addr, char* data, ssize_t length);
+    void listen_for_discovery();
 
-    void listen_for_ready(char* addr, bool& is_opponent_ready);
+    void listen_for_ready(char* addr, uint32_t game_number, bool& is_opponent_ready);
+    
+    // tournament bracket, players sorted by address and wins as (player index, round),
+    // only touched by the election thread
+    std::vector<in_addr_t> bracket_players;
+    std::set<std::pair<int, int>> bracket_wins;
+    uint64_t bracket_cursor = 0;
+    
+    int get_bracket_index(in_addr_t player);
+    void record_win(in_addr_t winner, in_addr_t loser);
+    bool is_bracket_winner(int player, int round);
 
-    void ntp_server(uint32_t& start_time);
-    NTPPacket ntp_listener(bool* received, bool time_request);
+    // recv_time is the kernel's arrival time of the datagram
+    void receive_ntp(sockaddr_in& src_addr, char* data, ssize_t length, int64_t recv_time);
+    void serve_ntp_request(sockaddr_in& src_addr, NTPPacket& packet, int64_t recv_time);
+    void expect_ntp_response(uint32_t request_id, uint8_t type);
+    bool receive_ntp_response(void* response, int64_t& recv_time);
 public:
     Network(int);
     ~Network();
     
     void set_local_addr();
     void discover_devices();
+    
+    // last confirmed roster, a restart that validates it skips discovery and the election
+    bool load_roster(const char* path, Roster& roster);
+    bool save_roster(const char* path, const char* master);
+    // pings the devices of roster until each has confirmed and committed it, takes it over on success
+    bool validate_roster(const Roster& roster);
+    
     void start_challenge_listener();
-    char* find_challenger(char**& game_status);
-    void wait_until_ready(char* addr);
-    void wait_for_challenge(char**& game_status);
+    void start_bracket();
+    // ceil(log2(NUMBER_OF_DEVICES))
+    int get_number_of_rounds();
+    char* find_opponent(int round);
+    void announce_win(char* loser);
+    // game_number tells replays and rounds against the same opponent apart
+    void wait_until_ready(char* addr, uint32_t game_number);
     void start_game(char* addr);
     short receive_move();
     void make_move(short m);
     void end_game();
-    int count_wins(char**& game_status);
-    void game_status_listener(char**& game_status, bool& listening);
-    void announce_status(char* addr, const char* result, char**& game_status);
     void announce_master();
+    // master without a tournament, see elect_lowest_address() in network.cpp
+    in_addr_t elect_lowest_address();
     void flush_game_buffer();
     
     void listen_for_master(char*& addr);
-    void start_ntp_server(uint32_t& start_time);
+    void start_ntp_server(std::atomic<int64_t>& start_time);
+    void report_primed();
+    void set_frame_report_handler(std::function<int64_t(int64_t, int64_t)> handler);
+    bool report_frame(char* addr, int64_t frame_index, int64_t swap_time, int64_t& skew);
     void stop_ntp_server();
-    NTPPacket request_time(char* addr);
+    bool request_time(char* addr, NTPPacket& packet);
     
     void sync_handler(uint32_t& start_time);
-    uint32_t request_start_time(char* addr);
+    int64_t request_start_time(char* addr);
     
     int get_ssdp_port();
     int get_ssdp_sckt();
@@ -373,11 +414,10 @@ public:
     int get_number_of_devices();
     int get_buffer_size();
     int get_message_size();
-    char** get_receiving_buffer();
+    PacketRing* get_receiving_buffer();
     int get_current_index();
     NetworkConfig* get_network_config();
     Game game;
-    ThreadPool thread_pool;
 };
 
 
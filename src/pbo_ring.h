@@ -0,0 +1,140 @@
+//
+//  pbo_ring.h
+//  vibes
+//
+//  Created by Justus Stahlhut on 18.10.26.
+//
+
+#ifndef pbo_ring_h
+#define pbo_ring_h
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <iostream>
+
+// one pixel unpack buffer per slot, so a slot can stay mapped while others are in use
+//
+// every upload out of a slot is followed by a fence, a slot is only written
+// again once the GPU has signaled that it finished reading it
+class PBORing {
+private:
+    std::vector<unsigned int> buffers;
+    std::vector<GLsync> fences;
+    size_t buffer_size;
+    
+    // slots read by the GPU, oldest first
+    std::deque<int> in_flight;
+    
+public:
+    PBORing(int number_of_slots, size_t buffer_size) : buffer_size(buffer_size) {
+        
+        buffers.resize(number_of_slots);
+        fences.resize(number_of_slots, nullptr);
+        glGenBuffers(number_of_slots, buffers.data());
+        
+        for (unsigned int buffer : buffers) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, buffer_size, NULL, GL_STREAM_DRAW);
+        }
+        
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    
+    // bind slot as source for glTexSubImage2D
+    void bind(int slot) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[slot]);
+    }
+    
+    // marks the slot as read by the commands issued so far
+    void fence(int slot) {
+        if (fences[slot] != nullptr) {
+            glDeleteSync(fences[slot]);
+        }
+        
+        fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        in_flight.push_back(slot);
+    }
+    
+    // true once the GPU is done with the slot, timeout 0 only polls
+    bool wait(int slot, GLuint64 timeout) {
+        if (fences[slot] == nullptr) {
+            return true;
+        }
+        
+        GLenum status = glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+        
+        if (status == GL_TIMEOUT_EXPIRED) {
+            return false;
+        }
+        
+        if (status == GL_WAIT_FAILED) {
+            std::cerr << "ERROR::PBO::FENCE_WAIT_FAILED::" << slot << std::endl;
+        }
+        
+        glDeleteSync(fences[slot]);
+        fences[slot] = nullptr;
+        in_flight.erase(std::remove(in_flight.begin(), in_flight.end(), slot), in_flight.end());
+        
+        return true;
+    }
+    
+    // oldest slot the GPU has finished reading, -1 if none (or none in flight)
+    int reclaim(bool block) {
+        if (in_flight.empty()) {
+            return -1;
+        }
+        
+        int slot = in_flight.front();
+        
+        if (!wait(slot, block ? GL_TIMEOUT_IGNORED : 0)) {
+            return -1;
+        }
+        
+        return slot;
+    }
+    
+    int get_slots_in_flight() {
+        return (int) in_flight.size();
+    }
+    
+    // copy a frame into the slot, waits for the GPU if it still reads the slot
+    void upload(int slot, const void* data, size_t size) {
+        wait(slot, GL_TIMEOUT_IGNORED);
+        bind(slot);
+        glBufferSubData(GL_PIXEL_UNPACK_BUFFER, 0, size, data);
+    }
+    
+    // map the slot for writing, the fence makes an unsynchronized mapping safe
+    uint8_t* map(int slot) {
+        wait(slot, GL_TIMEOUT_IGNORED);
+        bind(slot);
+        
+        void* data = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, buffer_size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        
+        if (data == nullptr) {
+            std::cerr << "ERROR::PBO::MAP_FAILED::" << slot << std::endl;
+        }
+        
+        return (uint8_t*) data;
+    }
+    
+    bool unmap(int slot) {
+        bind(slot);
+        
+        if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) != GL_TRUE) {
+            std::cerr << "ERROR::PBO::UNMAP_FAILED::" << slot << std::endl;
+            return false;
+        }
+        
+        return true;
+    }
+    
+    int get_number_of_slots() {
+        return (int) buffers.size();
+    }
+};
+
+#endif /* pbo_ring_h */
@@ -0,0 +1,239 @@
+//
+//  protocol.cpp
+//  vibes
+//
+//  Created by Justus Stahlhut on 18.10.26.
+//
+
+#include "protocol.hpp"
+
+#include <chrono>
+#include <string>
+
+static_assert(sizeof(MessageHeader) == 20, "MessageHeader has to match the wire size");
+static_assert(sizeof(Packet) == PACKET_SIZE, "Packet has to match the wire size");
+
+uint16_t fletcher16(std::span<const uint8_t> data, uint16_t seed) {
+    
+    uint16_t sum1 = seed & 0xFF;
+    uint16_t sum2 = seed >> 8;
+    
+    for (uint8_t byte : data) {
+        sum1 = (sum1 + byte) % 255;
+        sum2 = (sum2 + sum1) % 255;
+    }
+    
+    return (sum2 << 8) | sum1;
+}
+
+static uint16_t packet_checksum(const MessageHeader& wire_header, std::span<const uint8_t> payload) {
+    
+    MessageHeader header = wire_header;
+    header.checksum = 0;
+    
+    uint16_t sum = fletcher16(std::span<const uint8_t>((const uint8_t*) &header, sizeof(header)));
+    return fletcher16(payload, sum);
+}
+
+size_t encode_packet(const Packet& packet, uint8_t* out) {
+    
+    MessageHeader header;
+    std::memset(&header, 0, sizeof(header));
+    
+    header.version = PROTOCOL_VERSION;
+    header.type = packet.header.type;
+    header.length = htons(packet.header.length);
+    header.sender = packet.header.sender;
+    header.sequence = htonl(packet.header.sequence);
+    header.session = htons(packet.header.session);
+    header.window_start = htonl(packet.header.window_start);
+    header.checksum = htons(packet_checksum(header, packet.get_payload()));
+    
+    std::memcpy(out, &header, sizeof(header));
+    std::memcpy(out + sizeof(header), packet.payload, packet.header.length);
+    
+    return packet.get_size();
+}
+
+bool parse_packet(std::span<const uint8_t> datagram, MessageHeader& header, std::span<const uint8_t>& payload) {
+    
+    if (datagram.size() < sizeof(MessageHeader)) {
+        return false;
+    }
+    
+    std::memcpy(&header, datagram.data(), sizeof(header));
+    
+    uint16_t length = ntohs(header.length);
+    
+    if (header.version != PROTOCOL_VERSION || length > PAYLOAD_SIZE || datagram.size() != sizeof(MessageHeader) + length) {
+        return false;
+    }
+    
+    payload = datagram.subspan(sizeof(MessageHeader), length);
+    
+    if (ntohs(header.checksum) != packet_checksum(header, payload)) {
+        return false;
+    }
+    
+    header.length = length;
+    header.sequence = ntohl(header.sequence);
+    header.checksum = ntohs(header.checksum);
+    header.session = ntohs(header.session);
+    header.window_start = ntohl(header.window_start);
+    
+    return true;
+}
+
+void set_payload(Packet& packet, uint32_t value) {
+    
+    value = htonl(value);
+    std::memcpy(packet.payload, &value, sizeof(value));
+    packet.header.length = sizeof(value);
+}
+
+void set_payload(Packet& packet, int16_t value) {
+    
+    uint16_t wire_value = htons((uint16_t) value);
+    std::memcpy(packet.payload, &wire_value, sizeof(wire_value));
+    packet.header.length = sizeof(wire_value);
+}
+
+void set_addr_payload(Packet& packet, in_addr_t addr) {
+    
+    std::memcpy(packet.payload, &addr, sizeof(addr));
+    packet.header.length = sizeof(addr);
+}
+
+void set_ack_payload(Packet& packet, uint32_t cumulative, uint64_t selective) {
+    
+    uint32_t values[3] = {htonl(cumulative), htonl((uint32_t) (selective >> 32)), htonl((uint32_t) selective)};
+    std::memcpy(packet.payload, values, sizeof(values));
+    packet.header.length = sizeof(values);
+}
+
+void set_roster_payload(Packet& packet, uint32_t digest, bool is_committed) {
+    
+    uint32_t values[2] = {htonl(digest), htonl(is_committed ? 1 : 0)};
+    std::memcpy(packet.payload, values, sizeof(values));
+    packet.header.length = sizeof(values);
+}
+
+std::string_view get_message_name(MessageType type) {
+    
+    switch (type) {
+        case MSG_ACK:       return "ACK";
+        case MSG_SEARCH:    return "SEARCH";
+        case MSG_BUDDY:     return "BUDDY";
+        case MSG_READY:     return "READY";
+        case MSG_MOVE:      return "MOVE";
+        case MSG_GAME:      return "GAME";
+        case MSG_WIN:       return "WIN";
+        case MSG_LOSE:      return "LOSE";
+        case MSG_WAIT:      return "WAIT";
+        case MSG_MASTER:    return "MASTER";
+        case MSG_PING:      return "PING";
+        case MSG_PONG:      return "PONG";
+        case MSG_VOTE:      return "VOTE";
+        default:            return "NONE";
+    }
+}
+
+void report_protocol_rate(int number_of_messages) {
+    
+    const char* addr = "192.168.2.101";
+    const char* move = "MOVE 4";
+    const size_t message_size = 512;
+    
+    // keeps the parsed moves from being optimized away
+    volatile int64_t moves = 0;
+    
+    std::cout << "Message rate (" << number_of_messages << " messages):" << std::endl;
+    
+    {
+        // the former path, "addr::msg" formatted into the ring, copied out and split with std::string
+        char* ring[PacketRing::CAPACITY];
+        
+        for (int i=0; i!=PacketRing::CAPACITY; i++) {
+            ring[i] = new char[message_size];
+            std::memset(ring[i], 0, message_size);
+        }
+        
+        auto start = std::chrono::steady_clock::now();
+        
+        for (int i=0; i!=number_of_messages; i++) {
+            
+            char* buffer_msg = new char[message_size];
+            std::snprintf(buffer_msg, message_size, "%s::%s", addr, move);
+            std::memcpy(ring[i % PacketRing::CAPACITY], buffer_msg, message_size);
+            delete[] buffer_msg;
+            
+            char* scan_msg = new char[message_size];
+            std::memcpy(scan_msg, ring[i % PacketRing::CAPACITY], message_size);
+            
+            std::string buffer = std::string(scan_msg);
+            size_t delimiter_index = buffer.find("::");
+            std::string recv_addr = buffer.substr(0, delimiter_index);
+            std::string msg = buffer.substr(delimiter_index+2, buffer.size());
+            
+            char* val1 = new char[INET_ADDRSTRLEN > recv_addr.size() ? INET_ADDRSTRLEN : recv_addr.size()];
+            char* val2 = new char[INET_ADDRSTRLEN > msg.size() ? INET_ADDRSTRLEN : msg.size()];
+            std::memcpy(val1, recv_addr.c_str(), recv_addr.size() + 1);
+            std::memcpy(val2, msg.c_str(), msg.size() + 1);
+            
+            short field = 0;
+            std::sscanf(val2 + 5, "%hd", &field);
+            moves = moves + field;
+            
+            delete[] scan_msg;
+            delete[] val1;
+            delete[] val2;
+        }
+        
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "\ttext \"addr::msg\": " << number_of_messages / elapsed.count() << " messages/s" << std::endl;
+        
+        for (int i=0; i!=PacketRing::CAPACITY; i++) {
+            delete[] ring[i];
+        }
+    }
+    
+    {
+        // encoded, validated in place and copied into its ring slot
+        PacketRing* ring = new PacketRing();
+        
+        Packet packet;
+        std::memset(&packet, 0, sizeof(packet));
+        packet.header.type = MSG_MOVE;
+        packet.header.sender = inet_addr(addr);
+        set_payload(packet, (int16_t) 4);
+        
+        uint8_t datagram[PACKET_SIZE];
+        
+        auto start = std::chrono::steady_clock::now();
+        
+        for (int i=0; i!=number_of_messages; i++) {
+            
+            packet.header.sequence = i;
+            size_t size = encode_packet(packet, datagram);
+            
+            MessageHeader header;
+            std::span<const uint8_t> payload;
+            
+            if (!parse_packet(std::span<const uint8_t>(datagram, size), header, payload)) {
+                std::cerr << "Couldn't parse encoded packet" << std::endl;
+                break;
+            }
+            
+            Packet& slot = ring->packets[i % PacketRing::CAPACITY];
+            slot.header = header;
+            std::memcpy(slot.payload, payload.data(), payload.size());
+            
+            moves = moves + slot.get_i16();
+        }
+        
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "\tbinary header: " << number_of_messages / elapsed.count() << " messages/s" << std::endl;
+        
+        delete ring;
+    }
+}
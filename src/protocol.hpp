@@ -0,0 +1,141 @@
+//
+//  protocol.hpp
+//  vibes
+//
+//  Created by Justus Stahlhut on 18.10.26.
+//
+
+#ifndef protocol_hpp
+#define protocol_hpp
+
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+#include <arpa/inet.h>
+
+#define PROTOCOL_VERSION 2
+#define PACKET_SIZE 64
+
+enum MessageType : uint8_t {
+    // unused ring slot
+    MSG_NONE,
+    // sent with the session being acknowledged, payload: cumulative sequence (u32) and selective bitmap (u64)
+    MSG_ACK,
+    // discovery, multicast on the ssdp group, unnumbered
+    MSG_SEARCH,
+    // answer to MSG_SEARCH, unnumbered
+    MSG_BUDDY,
+    // payload: number of the game (round and replay)
+    MSG_READY,
+    // payload: field of the move
+    MSG_MOVE,
+    // unused since the bracket, kept for the numbering
+    MSG_GAME,
+    // won match, sent to every device, payload: address of the beaten opponent
+    MSG_WIN,
+    // unused since the bracket
+    MSG_LOSE,
+    MSG_WAIT,
+    MSG_MASTER,
+    // roster check of a restarted node, unicast to the disc port, unnumbered,
+    // payload: roster digest (u32), 1 once every device has confirmed it to the sender, else 0 (u32)
+    MSG_PING,
+    // answer to MSG_PING, same payload for the answering node (digest 0 without a confirmed roster)
+    MSG_PONG,
+    // lowest address election, payload: address voted for
+    MSG_VOTE
+};
+
+// every control message starts with this header, multi-byte fields in network order on the wire
+struct MessageHeader {
+    uint8_t version;
+    uint8_t type;
+    // payload bytes following the header
+    uint16_t length;
+    // ipv4 address of the sender (in_addr_t, network order in memory as well)
+    uint32_t sender;
+    // per peer, 0 for messages sent without acknowledgement
+    uint32_t sequence;
+    // fletcher-16 over header and payload, computed with this field zeroed
+    uint16_t checksum;
+    // random per run of the sender, a new one restarts the receiver's numbering
+    uint16_t session;
+    // lowest sequence the sender still waits to have acknowledged by the receiver, everything
+    // below is acknowledged or given up (a restarted receiver starts its window here), 0 if unnumbered
+    uint32_t window_start;
+};
+
+#define PAYLOAD_SIZE (PACKET_SIZE - sizeof(MessageHeader))
+
+// one message, headers in host order apart from sender
+struct Packet {
+    MessageHeader header;
+    uint8_t payload[PAYLOAD_SIZE];
+    
+    MessageType get_type() const {
+        return (MessageType) header.type;
+    }
+    
+    std::span<const uint8_t> get_payload() const {
+        return std::span<const uint8_t>(payload, header.length);
+    }
+    
+    size_t get_size() const {
+        return sizeof(MessageHeader) + header.length;
+    }
+    
+    uint32_t get_u32(size_t offset = 0) const {
+        uint32_t value = 0;
+        std::memcpy(&value, payload + offset, sizeof(value));
+        return ntohl(value);
+    }
+    
+    uint64_t get_u64(size_t offset = 0) const {
+        return ((uint64_t) get_u32(offset) << 32) | get_u32(offset + 4);
+    }
+    
+    int16_t get_i16() const {
+        uint16_t value = 0;
+        std::memcpy(&value, payload, sizeof(value));
+        return (int16_t) ntohs(value);
+    }
+    
+    // address payload of status messages, kept in network order like sender
+    in_addr_t get_addr() const {
+        in_addr_t addr = 0;
+        std::memcpy(&addr, payload, sizeof(addr));
+        return addr;
+    }
+};
+
+// received messages of one socket, overwritten oldest first
+struct PacketRing {
+    static constexpr int CAPACITY = 128;
+    
+    Packet packets[CAPACITY];
+    int counter = 0;
+    // slots in use, all of them once the ring has wrapped
+    int size = 0;
+    // appended since the last flush, message n sits in slot n % CAPACITY until it's overwritten
+    uint64_t total = 0;
+};
+
+uint16_t fletcher16(std::span<const uint8_t> data, uint16_t seed = 0);
+// wire image of packet in out (PACKET_SIZE bytes), returns the bytes to send
+size_t encode_packet(const Packet& packet, uint8_t* out);
+// validates a datagram in place, header in host order and payload pointing into the datagram,
+// false for foreign traffic (e.g. other ssdp devices), other versions and corrupt datagrams
+bool parse_packet(std::span<const uint8_t> datagram, MessageHeader& header, std::span<const uint8_t>& payload);
+void set_payload(Packet& packet, uint32_t value);
+void set_payload(Packet& packet, int16_t value);
+void set_addr_payload(Packet& packet, in_addr_t addr);
+void set_ack_payload(Packet& packet, uint32_t cumulative, uint64_t selective);
+void set_roster_payload(Packet& packet, uint32_t digest, bool is_committed);
+std::string_view get_message_name(MessageType type);
+// messages/sec of the former "addr::msg" text path and of this protocol
+void report_protocol_rate(int number_of_messages);
+
+#endif /* protocol_hpp */
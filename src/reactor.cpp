@@ -0,0 +1,338 @@
+//
+//  reactor.cpp
+//  vibes
+//
+//  Created by Justus Stahlhut on 18.10.26.
+//
+
+#include "reactor.hpp"
+
+#include <chrono>
+
+#ifdef __linux__
+    #include <sys/epoll.h>
+    #include <sys/eventfd.h>
+    #include <time.h>
+#else
+    #include <poll.h>
+    #include <fcntl.h>
+    #include <vector>
+#endif
+
+Reactor::Reactor(size_t datagram_size) : datagram_size(datagram_size) {
+    
+    #ifdef __linux__
+        poll_fd = epoll_create1(EPOLL_CLOEXEC);
+        wake_fd[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        wake_fd[1] = wake_fd[0];
+        
+        if (poll_fd < 0 || wake_fd[0] < 0) {
+            std::cerr << "Error while creating reactor: " << strerror(errno) << std::endl;
+            exit(1);
+        }
+        
+        struct epoll_event event;
+        std::memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.fd = wake_fd[0];
+        
+        if (epoll_ctl(poll_fd, EPOLL_CTL_ADD, wake_fd[0], &event) < 0) {
+            std::cerr << "Error while registering reactor wakeup: " << strerror(errno) << std::endl;
+            exit(1);
+        }
+    #else
+        if (pipe(wake_fd) < 0) {
+            std::cerr << "Error while creating reactor: " << strerror(errno) << std::endl;
+            exit(1);
+        }
+        
+        fcntl(wake_fd[0], F_SETFL, O_NONBLOCK);
+        fcntl(wake_fd[1], F_SETFL, O_NONBLOCK);
+    #endif
+}
+
+Reactor::~Reactor() {
+    
+    stop();
+    
+    #ifdef __linux__
+        close(wake_fd[0]);
+        close(poll_fd);
+    #else
+        close(wake_fd[0]);
+        close(wake_fd[1]);
+    #endif
+}
+
+bool Reactor::add_socket(int sckt, Handler handler) {
+    
+    std::lock_guard<std::mutex> lock(handler_mutex);
+    
+    #ifdef __linux__
+        struct epoll_event event;
+        std::memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.fd = sckt;
+        
+        int op = handlers.count(sckt) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        
+        if (epoll_ctl(poll_fd, op, sckt, &event) < 0) {
+            std::cerr << "Error while adding socket to reactor: " << strerror(errno) << std::endl;
+            return false;
+        }
+        
+        // falls back to the time after the syscall
+        int enable = 1;
+        
+        if (setsockopt(sckt, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) < 0) {
+            std::cerr << "Error enabling receive timestamps: " << strerror(errno) << std::endl;
+        }
+    #endif
+    
+    handlers[sckt] = handler;
+    
+    // poll() picks up the new socket on its next round
+    wake();
+    
+    return true;
+}
+
+void Reactor::remove_socket(int sckt) {
+    
+    std::unique_lock<std::mutex> lock(handler_mutex);
+    
+    if (handlers.erase(sckt) == 0) {
+        return;
+    }
+    
+    #ifdef __linux__
+        epoll_ctl(poll_fd, EPOLL_CTL_DEL, sckt, nullptr);
+    #endif
+    
+    // a handler removing its own socket would wait for itself
+    if (std::this_thread::get_id() != reactor_thread.get_id()) {
+        dispatch_cv.wait(lock, [this, sckt]() { return dispatching != sckt; });
+    }
+    
+    wake();
+}
+
+void Reactor::start() {
+    
+    if (running) {
+        return;
+    }
+    
+    running = true;
+    reactor_thread = std::thread(&Reactor::run, this);
+}
+
+void Reactor::stop() {
+    
+    running = false;
+    wake();
+    
+    if (reactor_thread.joinable()) {
+        reactor_thread.join();
+    }
+}
+
+bool Reactor::is_running() {
+    return running;
+}
+
+void Reactor::wake() {
+    
+    #ifdef __linux__
+        uint64_t one = 1;
+        write(wake_fd[1], &one, sizeof(one));
+    #else
+        char one = 1;
+        write(wake_fd[1], &one, sizeof(one));
+    #endif
+}
+
+void Reactor::drain_wake() {
+    
+    #ifdef __linux__
+        uint64_t count;
+        read(wake_fd[0], &count, sizeof(count));
+    #else
+        char drain[64];
+        while (read(wake_fd[0], drain, sizeof(drain)) > 0) {}
+    #endif
+}
+
+// runs the handler of sckt without holding the lock, handlers may add and remove sockets
+void Reactor::dispatch(int sckt, char* buffers) {
+    
+    Handler handler;
+    
+    {
+        std::lock_guard<std::mutex> lock(handler_mutex);
+        
+        auto entry = handlers.find(sckt);
+        
+        if (entry == handlers.end()) {
+            return;
+        }
+        
+        // a copy, the entry may be replaced or erased while it runs
+        handler = entry->second;
+        dispatching = sckt;
+    }
+    
+    receive(sckt, buffers, handler);
+    
+    {
+        std::lock_guard<std::mutex> lock(handler_mutex);
+        dispatching = -1;
+    }
+    
+    dispatch_cv.notify_all();
+}
+
+void Reactor::receive(int sckt, char* buffers, Handler& handler) {
+    
+    #ifdef __linux__
+        struct mmsghdr headers[MAX_BURST];
+        struct iovec iovecs[MAX_BURST];
+        struct sockaddr_in src_addrs[MAX_BURST];
+        char controls[MAX_BURST][CMSG_SPACE(sizeof(struct timespec))];
+        
+        for (int i=0; i!=MAX_BURST; i++) {
+        
+            iovecs[i].iov_base = buffers + i * datagram_size;
+            iovecs[i].iov_len = datagram_size - 1;
+        
+            std::memset(&headers[i], 0, sizeof(headers[i]));
+            headers[i].msg_hdr.msg_name = &src_addrs[i];
+            headers[i].msg_hdr.msg_namelen = sizeof(src_addrs[i]);
+            headers[i].msg_hdr.msg_iov = &iovecs[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+            headers[i].msg_hdr.msg_control = controls[i];
+            headers[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+        }
+        
+        int received = recvmmsg(sckt, headers, MAX_BURST, MSG_DONTWAIT, nullptr);
+        
+        if (received < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                std::cerr << "Error while receiving message: " << strerror(errno) << std::endl;
+            }
+            return;
+        }
+        
+        // kernel timestamps are on the realtime clock, their age carries over to the steady one
+        struct timespec real_now;
+        clock_gettime(CLOCK_REALTIME, &real_now);
+        int64_t steady_now = get_steady_time_ns();
+        
+        for (int i=0; i!=received; i++) {
+            
+            int64_t recv_time = steady_now;
+            
+            for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&headers[i].msg_hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&headers[i].msg_hdr, cmsg)) {
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+                    
+                    struct timespec stamp;
+                    std::memcpy(&stamp, CMSG_DATA(cmsg), sizeof(stamp));
+                    
+                    int64_t age = (real_now.tv_sec - stamp.tv_sec) * 1000000000ll + (real_now.tv_nsec - stamp.tv_nsec);
+                    
+                    if (age >= 0) {
+                        recv_time = steady_now - age;
+                    }
+                }
+            }
+            
+            char* buffer = buffers + i * datagram_size;
+            buffer[headers[i].msg_len] = '\0';
+            
+            handler(src_addrs[i], buffer, headers[i].msg_len, recv_time);
+        }
+    #else
+        for (int i=0; i!=MAX_BURST; i++) {
+            
+            struct sockaddr_in src_addr;
+            std::memset(&src_addr, 0, sizeof(src_addr));
+            socklen_t src_addr_len = sizeof(src_addr);
+            
+            ssize_t length = recvfrom(sckt, buffers, datagram_size - 1, MSG_DONTWAIT, (struct sockaddr*) &src_addr, &src_addr_len);
+            
+            if (length < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    std::cerr << "Error while receiving message: " << strerror(errno) << std::endl;
+                }
+                return;
+            }
+            
+            buffers[length] = '\0';
+            handler(src_addr, buffers, length, get_steady_time_ns());
+        }
+    #endif
+}
+
+void Reactor::run() {
+    
+    // one slot per datagram of a burst, reused for every socket
+    char* buffers = new char[datagram_size * MAX_BURST];
+    
+    #ifdef __linux__
+        struct epoll_event events[16];
+        
+        while (running) {
+            
+            int ready = epoll_wait(poll_fd, events, 16, -1);
+            
+            if (ready < 0) {
+                if (errno != EINTR) {
+                    std::cerr << "Error while waiting for sockets: " << strerror(errno) << std::endl;
+                }
+                continue;
+            }
+            
+            for (int i=0; i!=ready && running; i++) {
+                if (events[i].data.fd == wake_fd[0]) {
+                    drain_wake();
+                } else {
+                    dispatch(events[i].data.fd, buffers);
+                }
+            }
+        }
+    #else
+        std::vector<struct pollfd> poll_fds;
+        
+        while (running) {
+            
+            poll_fds.clear();
+            poll_fds.push_back({wake_fd[0], POLLIN, 0});
+            
+            {
+                std::lock_guard<std::mutex> lock(handler_mutex);
+                for (auto& handler : handlers) {
+                    poll_fds.push_back({handler.first, POLLIN, 0});
+                }
+            }
+            
+            if (poll(poll_fds.data(), poll_fds.size(), -1) < 0) {
+                if (errno != EINTR) {
+                    std::cerr << "Error while waiting for sockets: " << strerror(errno) << std::endl;
+                }
+                continue;
+            }
+            
+            if (poll_fds[0].revents & POLLIN) {
+                drain_wake();
+            }
+            
+            for (int i=1; i!=poll_fds.size() && running; i++) {
+                if (poll_fds[i].revents & POLLIN) {
+                    dispatch(poll_fds[i].fd, buffers);
+                }
+            }
+        }
+    #endif
+    
+    delete[] buffers;
+}
@@ -0,0 +1,74 @@
+//
+//  reactor.hpp
+//  vibes
+//
+//  Created by Justus Stahlhut on 18.10.26.
+//
+
+#ifndef reactor_hpp
+#define reactor_hpp
+
+#include <iostream>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <unordered_map>
+
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+// nanoseconds on the monotonic clock, only differences between nodes are meaningful
+inline int64_t get_steady_time_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// one thread waiting on every registered udp socket (epoll, poll() where there is none),
+// each datagram is handed to the handler of its socket on that thread
+class Reactor {
+public:
+    // source of the datagram, data is terminated after length bytes,
+    // recv_time is the kernel's arrival time on the steady clock where there is one
+    using Handler = std::function<void(sockaddr_in& src_addr, char* data, ssize_t length, int64_t recv_time)>;
+    
+    Reactor(size_t datagram_size);
+    ~Reactor();
+    
+    // turns on kernel receive timestamps (SO_TIMESTAMPNS) for sckt
+    bool add_socket(int sckt, Handler handler);
+    // the handler of sckt isn't running anymore once this returns (unless called from a handler)
+    void remove_socket(int sckt);
+    void start();
+    // wakes the reactor thread and joins it, registered sockets stay open
+    void stop();
+    bool is_running();
+private:
+    // datagrams read per socket and wakeup (one recvmmsg() call), keeps a busy socket from starving the others
+    static constexpr int MAX_BURST = 32;
+    
+    size_t datagram_size;
+    // epoll instance, unused with poll()
+    int poll_fd = -1;
+    // eventfd (both ends the same) or self-pipe
+    int wake_fd[2] = {-1, -1};
+    
+    std::unordered_map<int, Handler> handlers;
+    std::mutex handler_mutex;
+    // socket whose handler runs right now (-1 for none), remove_socket() waits on it
+    int dispatching = -1;
+    std::condition_variable dispatch_cv;
+    std::thread reactor_thread;
+    std::atomic<bool> running = false;
+    
+    void run();
+    void wake();
+    void drain_wake();
+    void dispatch(int sckt, char* buffers);
+    void receive(int sckt, char* buffers, Handler& handler);
+};
+
+#endif /* reactor_hpp */
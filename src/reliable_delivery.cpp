@@ -0,0 +1,271 @@
+//
+//  reliable_delivery.cpp
+//  vibes
+//
+//  Created by Justus Stahlhut on 18.10.26.
+//
+
+#include "reliable_delivery.hpp"
+
+#include <random>
+#include <vector>
+#include <algorithm>
+
+static uint16_t random_session() {
+    
+    std::random_device random_device;
+    std::uniform_int_distribution<int> distribution(1, UINT16_MAX);
+    
+    return (uint16_t) distribution(random_device);
+}
+
+ReliableDelivery::ReliableDelivery(Retransmit retransmit) : session(random_session()), retransmit(retransmit), timers(TICK, NUMBER_OF_SLOTS) {}
+
+ReliableDelivery::~ReliableDelivery() {
+    stop();
+}
+
+void ReliableDelivery::start() {
+    
+    if (running) {
+        return;
+    }
+    
+    running = true;
+    retransmit_thread = std::thread(&ReliableDelivery::run, this);
+}
+
+void ReliableDelivery::stop() {
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    
+    timer_cv.notify_all();
+    delivery_cv.notify_all();
+    
+    if (retransmit_thread.joinable()) {
+        retransmit_thread.join();
+    }
+}
+
+uint32_t ReliableDelivery::track(int sckt, const sockaddr_in& dest_addr, Packet& packet, int retries) {
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    Peer& peer = peers[dest_addr.sin_addr.s_addr];
+    
+    packet.header.sequence = ++peer.last_sequence;
+    packet.header.session = session;
+    packet.header.window_start = peer.in_flight.empty() ? packet.header.sequence : peer.in_flight.begin()->first;
+    
+    peer.in_flight[packet.header.sequence] = {sckt, dest_addr, packet, retries, INITIAL_TIMEOUT, false};
+    
+    return packet.header.sequence;
+}
+
+void ReliableDelivery::sent(in_addr_t peer, uint32_t sequence) {
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        
+        auto entry = peers.find(peer);
+        
+        if (entry == peers.end()) {
+            return;
+        }
+        
+        // acknowledged before we got here
+        auto message = entry->second.in_flight.find(sequence);
+        
+        if (message == entry->second.in_flight.end() || message->second.is_sent) {
+            return;
+        }
+        
+        message->second.is_sent = true;
+        timers.schedule({peer, sequence}, std::chrono::steady_clock::now() + message->second.timeout);
+    }
+    
+    timer_cv.notify_one();
+}
+
+void ReliableDelivery::acknowledge(in_addr_t peer, uint16_t session, uint32_t cumulative, uint64_t selective) {
+    
+    // answer to an earlier run of ours
+    if (session != this->session) {
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        
+        auto entry = peers.find(peer);
+        
+        if (entry == peers.end()) {
+            return;
+        }
+        
+        std::map<uint32_t, InFlight>& in_flight = entry->second.in_flight;
+        in_flight.erase(in_flight.begin(), in_flight.upper_bound(cumulative));
+        
+        for (uint32_t i=0; selective != 0 && i!=WINDOW; i++, selective >>= 1) {
+            if (selective & 1) {
+                in_flight.erase(cumulative + 1 + i);
+            }
+        }
+    }
+    
+    delivery_cv.notify_all();
+}
+
+bool ReliableDelivery::wait_for_delivery(in_addr_t peer, uint32_t sequence) {
+    
+    std::unique_lock<std::mutex> lock(mutex);
+    
+    auto is_pending = [this, peer, sequence]() {
+        Peer& entry = peers[peer];
+        return entry.in_flight.count(sequence) != 0;
+    };
+    
+    delivery_cv.wait(lock, [this, &is_pending]() { return !running || !is_pending(); });
+    
+    return !is_pending() && peers[peer].lost.count(sequence) == 0;
+}
+
+bool ReliableDelivery::accept(in_addr_t peer, uint16_t session, uint32_t sequence, uint32_t window_start, uint32_t& cumulative, uint64_t& selective) {
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    Peer& entry = peers[peer];
+    
+    // first message of a (restarted) peer, or we have restarted, the sender knows where the window starts
+    if (entry.session != session) {
+        entry.session = session;
+        entry.cumulative = 0;
+        entry.selective = 0;
+    }
+    
+    // everything below window_start has been acknowledged (by an earlier run of ours) or given up
+    if (window_start > 0 && window_start - 1 > entry.cumulative) {
+        
+        uint32_t shift = window_start - 1 - entry.cumulative;
+        
+        entry.selective = shift >= WINDOW ? 0 : entry.selective >> shift;
+        entry.cumulative = window_start - 1;
+    }
+    
+    bool is_new = false;
+    
+    if (sequence > entry.cumulative && sequence - entry.cumulative <= WINDOW) {
+        
+        uint64_t bit = 1ull << (sequence - entry.cumulative - 1);
+        
+        is_new = (entry.selective & bit) == 0;
+        entry.selective |= bit;
+        
+        // slide over everything received without gap
+        while (entry.selective & 1) {
+            entry.selective >>= 1;
+            entry.cumulative++;
+        }
+    }
+    
+    cumulative = entry.cumulative;
+    selective = entry.selective;
+    
+    return is_new;
+}
+
+uint16_t ReliableDelivery::get_session() {
+    return session;
+}
+
+size_t ReliableDelivery::get_in_flight() {
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    size_t in_flight = 0;
+    
+    for (auto& entry : peers) {
+        in_flight += entry.second.in_flight.size();
+    }
+    
+    return in_flight;
+}
+
+void ReliableDelivery::run() {
+    
+    std::vector<InFlight> resend;
+    std::unique_lock<std::mutex> lock(mutex);
+    
+    while (running) {
+        
+        // no ticking while nothing is in flight
+        if (timers.empty()) {
+            timer_cv.wait(lock, [this]() { return !running || !timers.empty(); });
+        } else {
+            timer_cv.wait_for(lock, TICK);
+        }
+        
+        auto now = std::chrono::steady_clock::now();
+        bool has_given_up = false;
+        
+        timers.advance(now, [this, now, &resend, &has_given_up](Timer& timer) {
+            
+            auto entry = peers.find(timer.peer);
+            
+            if (entry == peers.end()) {
+                return;
+            }
+            
+            auto message = entry->second.in_flight.find(timer.sequence);
+            
+            // acknowledged in the meantime
+            if (message == entry->second.in_flight.end()) {
+                return;
+            }
+            
+            InFlight& in_flight = message->second;
+            
+            if (in_flight.retries <= 0) {
+                
+                char addr[INET_ADDRSTRLEN];
+                inet_ntop(AF_INET, &timer.peer, addr, INET_ADDRSTRLEN);
+                std::cerr << "Giving up on " << get_message_name(in_flight.packet.get_type()) << " " << timer.sequence << " to " << addr << std::endl;
+                
+                entry->second.lost.insert(timer.sequence);
+                entry->second.in_flight.erase(message);
+                has_given_up = true;
+                return;
+            }
+            
+            in_flight.retries--;
+            in_flight.timeout = std::min(in_flight.timeout * 2, MAX_TIMEOUT);
+            timers.schedule(timer, now + in_flight.timeout);
+            
+            // earlier ones may have been acknowledged or given up since
+            in_flight.packet.header.window_start = entry->second.in_flight.begin()->first;
+            
+            resend.push_back(in_flight);
+        });
+        
+        if (has_given_up) {
+            delivery_cv.notify_all();
+        }
+        
+        if (resend.empty()) {
+            continue;
+        }
+        
+        // sent without holding the lock, the reactor acknowledges meanwhile
+        lock.unlock();
+        
+        for (InFlight& in_flight : resend) {
+            retransmit(in_flight.sckt, in_flight.dest_addr, in_flight.packet);
+        }
+        
+        resend.clear();
+        lock.lock();
+    }
+}
@@ -0,0 +1,118 @@
+//
+//  reliable_delivery.hpp
+//  vibes
+//
+//  Created by Justus Stahlhut on 18.10.26.
+//
+
+#ifndef reliable_delivery_hpp
+#define reliable_delivery_hpp
+
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <unordered_map>
+#include <map>
+#include <set>
+
+#include <arpa/inet.h>
+
+#include "protocol.hpp"
+#include "timer_wheel.hpp"
+
+// sequence numbers, acknowledgements and retransmits of the control messages
+//
+// every node numbers its messages per peer from 1 and stamps them with its session
+// (random per run, so a restarted peer starts over). the receiver answers each message
+// with the highest sequence received without gap (cumulative) and a bitmap of the
+// WINDOW sequences after it (selective), duplicates are acknowledged again but dropped.
+// every message carries the sender's lowest unacknowledged sequence, so a restarted
+// receiver (or one waiting on a message that has been given up) knows where the window starts.
+// unacknowledged messages wait in one timer wheel and are handed back for resending
+// with a doubling timeout until they are acknowledged or out of retries.
+class ReliableDelivery {
+public:
+    // sends an already encoded message again, called on the retransmit thread
+    using Retransmit = std::function<void(int sckt, sockaddr_in& dest_addr, const Packet& packet)>;
+    
+    // sequences ahead of the cumulative one a receiver keeps track of, later ones are dropped
+    // unacknowledged and resent once the window has moved
+    static constexpr uint32_t WINDOW = 64;
+    
+    ReliableDelivery(Retransmit retransmit);
+    ~ReliableDelivery();
+    
+    void start();
+    void stop();
+    
+    // numbers packet for dest_addr and keeps it until it's acknowledged or given up,
+    // retries is the number of resends, returns the sequence number
+    uint32_t track(int sckt, const sockaddr_in& dest_addr, Packet& packet, int retries);
+    // starts the retransmit timer once the message is on the wire for the first time
+    void sent(in_addr_t peer, uint32_t sequence);
+    void acknowledge(in_addr_t peer, uint16_t session, uint32_t cumulative, uint64_t selective);
+    // true once acknowledged, false if it was given up or the delivery layer stops
+    bool wait_for_delivery(in_addr_t peer, uint32_t sequence);
+    
+    // records a received message, false for duplicates and messages beyond the window,
+    // cumulative and selective are what to acknowledge either way. window_start is the
+    // sender's lowest unacknowledged sequence, the window never lags behind it.
+    bool accept(in_addr_t peer, uint16_t session, uint32_t sequence, uint32_t window_start, uint32_t& cumulative, uint64_t& selective);
+    
+    uint16_t get_session();
+    size_t get_in_flight();
+private:
+    static constexpr std::chrono::milliseconds TICK = std::chrono::milliseconds(10);
+    static constexpr size_t NUMBER_OF_SLOTS = 256;
+    static constexpr std::chrono::milliseconds INITIAL_TIMEOUT = std::chrono::milliseconds(200);
+    static constexpr std::chrono::milliseconds MAX_TIMEOUT = std::chrono::milliseconds(1600);
+    
+    struct InFlight {
+        int sckt;
+        sockaddr_in dest_addr;
+        Packet packet;
+        int retries;
+        std::chrono::milliseconds timeout;
+        bool is_sent;
+    };
+    
+    struct Timer {
+        in_addr_t peer;
+        uint32_t sequence;
+    };
+    
+    struct Peer {
+        // sending side
+        uint32_t last_sequence = 0;
+        std::map<uint32_t, InFlight> in_flight;
+        // given up without acknowledgement
+        std::set<uint32_t> lost;
+        
+        // receiving side
+        uint16_t session = 0;
+        uint32_t cumulative = 0;
+        // bit i is sequence cumulative+1+i
+        uint64_t selective = 0;
+    };
+    
+    const uint16_t session;
+    Retransmit retransmit;
+    
+    std::unordered_map<in_addr_t, Peer> peers;
+    // acknowledgements are lazy, a timer of a message that is gone just expires
+    TimerWheel<Timer> timers;
+    
+    std::mutex mutex;
+    std::condition_variable timer_cv;
+    std::condition_variable delivery_cv;
+    std::thread retransmit_thread;
+    std::atomic<bool> running = false;
+    
+    void run();
+};
+
+#endif /* reliable_delivery_hpp */
@@ -19,6 +19,7 @@ class Shader {
 private:
     unsigned int rgb_program_id;
     unsigned int texture_program_id;
+    unsigned int yuv_program_id = 0;
     
     // current used program
     unsigned int ID;
@@ -67,6 +68,27 @@ private:
         }
     }
     
+    std::string read_shader_file(const char* path) {
+        
+        std::ifstream shader_file;
+        shader_file.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+        
+        try {
+            shader_file.open(path);
+            
+            std::stringstream shader_stream;
+            shader_stream << shader_file.rdbuf();
+            shader_file.close();
+            
+            return shader_stream.str();
+        } catch(std::ifstream::failure e) {
+            std::cerr << "ERROR::SHADER::FILE_NOT_SUCESSFULLY_READ" << std::endl;
+            std::cerr << "\t" << e.what() << std::endl;
+        }
+        
+        return "";
+    }
+    
     
 public:
     // constructor reads and builds the shader
@@ -147,6 +169,26 @@ public:
         glDeleteShader(tex_fragment_shader);
     }
     
+    // program sampling the Y, U and V planes, converts to RGB on the GPU
+    void load_yuv_shader(const char* vertex_path, const char* fragment_path) {
+        
+        std::string vertex_code = read_shader_file(vertex_path);
+        std::string fragment_code = read_shader_file(fragment_path);
+        
+        unsigned int vertex_shader = create_and_compile_shader(GL_VERTEX_SHADER, vertex_code.c_str());
+        unsigned int fragment_shader = create_and_compile_shader(GL_FRAGMENT_SHADER, fragment_code.c_str());
+        
+        yuv_program_id = glCreateProgram();
+        
+        glAttachShader(yuv_program_id, vertex_shader);
+        glAttachShader(yuv_program_id, fragment_shader);
+        
+        link_program(yuv_program_id);
+        
+        glDeleteShader(vertex_shader);
+        glDeleteShader(fragment_shader);
+    }
+    
     // use / activate shader
     void use_rgb_shader() {
         glUseProgram(rgb_program_id);
@@ -158,6 +200,11 @@ public:
         ID = texture_program_id;
     }
     
+    void use_yuv_shader() {
+        glUseProgram(yuv_program_id);
+        ID = yuv_program_id;
+    }
+    
     // utitlity uniform functions
     void set_bool(const std::string &name, bool value)  const {
         glUniform1i(glGetUniformLocation(ID, name.c_str()), (int) value);
@@ -0,0 +1,18 @@
+#version 330 core
+
+in vec2 texture_coords;
+
+out vec4 frag_color;
+
+uniform sampler2D y_texture;
+uniform sampler2D u_texture;
+uniform sampler2D v_texture;
+
+// BT.601 limited range
+void main() {
+   float y = (texture(y_texture, texture_coords).r - 0.0625) * 1.164;
+   float u = texture(u_texture, texture_coords).r - 0.5;
+   float v = texture(v_texture, texture_coords).r - 0.5;
+   
+   frag_color = vec4(y + 1.596 * v, y - 0.392 * u - 0.813 * v, y + 2.017 * u, 1.0);
+}
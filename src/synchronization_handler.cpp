@@ -12,136 +12,127 @@ SynchronizationHandler::SynchronizationHandler(Network& net) : network(net) {
 
     is_master = false;
     ntp_server = nullptr;
+    is_restored = false;
     start_time = 0;
     offset = 0;
-    
-    game_status = new char*[16];
-    
-    for (int i=0; i!=16; i++) {
-        game_status[i] = new char[MESSAGE_SIZE];
-        *game_status[i] = '\0';
-    }
+    delay = 0;
+    pending_skew = 0;
 }
 
-void SynchronizationHandler::play(char* challenger) {
+SynchronizationHandler::~SynchronizationHandler() {
+    stop_clock_discipline();
+}
 
-    network.announce_status(challenger, "GAME", game_status);
-    ttt.reset();
-    network.start_game(challenger);
-    std::cout << "Waiting Until Opponent is Ready." << std::endl;
-    network.wait_until_ready(challenger);
+// plays against challenger until one of them has won, draws are replayed
+void SynchronizationHandler::play(char* challenger, int round) {
+
+    for (uint32_t replay=0; ; replay++) {
     
-    std::cout << "Starting Game." << std::endl;
+        ttt.reset();
+        network.start_game(challenger);
+        std::cout << "Waiting Until Opponent is Ready." << std::endl;
+        network.wait_until_ready(challenger, (uint32_t) round << 16 | replay);
     
-    if (std::strcmp(network.get_network_config()->address, challenger) < 0) {
-        ttt.player = 'X';
-        ttt.opponent = 'O';
-        ttt.is_move = true;
-    } else {
-        ttt.player = 'O';
-        ttt.opponent = 'X';
-        ttt.is_move = false;
-    }
+        std::cout << "Starting Game." << std::endl;
     
-    ttt.new_move = true;
-    ttt.cv.notify_one();
+        if (std::strcmp(network.get_network_config()->address, challenger) < 0) {
+            ttt.player = 'X';
+            ttt.opponent = 'O';
+            ttt.is_move = true;
+        } else {
+            ttt.player = 'O';
+            ttt.opponent = 'X';
+            ttt.is_move = false;
+        }
     
-    std::cout << " -------------------" << std::endl;
-    std::cout << " | Player: " << ttt.player << "       |" << std::endl;
-    std::cout << " | Opponent: " << ttt.opponent << "     |" << std::endl;
-    std::cout << " -------------------" << std::endl;
+        ttt.new_move = true;
+        ttt.cv.notify_one();
     
-    while (!ttt.is_game_over()) {
-        if (ttt.is_move) {
-            short move;
-            while (ttt.is_move) {
-                move = rand() % 9;
+        std::cout << " -------------------" << std::endl;
+        std::cout << " | Player: " << ttt.player << "       |" << std::endl;
+        std::cout << " | Opponent: " << ttt.opponent << "     |" << std::endl;
+        std::cout << " -------------------" << std::endl;
+        
+        while (!ttt.is_game_over()) {
+            if (ttt.is_move) {
+                short move;
+                while (ttt.is_move) {
+                    move = rand() % 9;
+                    ttt.make_move(move);
+                }
+                
+                network.make_move(move);
+            
+            } else {
+                short move = network.receive_move();
                 ttt.make_move(move);
             }
+        }
             
-            network.make_move(move);
+        network.end_game();
             
-        } else {
-            short move = network.receive_move();
-            ttt.make_move(move);
+        std::cout << " -------------------" << std::endl;
+        
+        if (!ttt.is_draw) {
+            break;
         }
+        
+        std::cout << " | Draw.           |" << std::endl;
+        std::cout << " -------------------" << std::endl;
     }
     
-    network.end_game();
-    
-    std::cout << " -------------------" << std::endl;
-    
     if (ttt.is_won) {
         std::cout << " | Won.            |" << std::endl;
         std::cout << " -------------------" << std::endl;
-    } else if (ttt.is_draw) {
-        std::cout << " | Draw.           |" << std::endl;
-        std::cout << " -------------------" << std::endl;
-        play(challenger);
-        return;
+        network.announce_win(challenger);
     } else {
         std::cout << " | Lost.           |" << std::endl;
         std::cout << " -------------------" << std::endl;
     }
-    
-    ttt.is_over = true;
-    ttt.cv.notify_one();
-    
-    if (ttt.is_won) {
-        network.announce_status(challenger, "WIN", game_status);
-    } else {
-        network.announce_status(challenger, "LOSE", game_status);
-    }
 }
 
-void SynchronizationHandler::determine_master() {
+// bracket of ceil(log2(n)) rounds, every node plays its match of a round as soon as the group
+// next to it has a winner, so the matches of a round run concurrently
+void SynchronizationHandler::determine_master(ElectionStrategy strategy) {
     
-    bool next_round = true;
+    if (strategy == ELECTION_LOWEST_ADDRESS) {
+        set_master(network.elect_lowest_address());
+        return;
+    }
+    
+    network.start_bracket();
 
-    network.start_challenge_listener();
-    std::thread status_listener([this, &next_round]() { network.game_status_listener(game_status, next_round); });
+    is_master = true;
     
-    int wins = 0;
+    for (int round=0; round!=network.get_number_of_rounds() && is_master; round++) {
     
-    while (next_round) {
-        char* challenger = network.find_challenger(game_status);
+        char* challenger = network.find_opponent(round);
         
         if (challenger == nullptr) {
-            std::cout << "Waiting for next Game..." << std::endl;
-            network.announce_status(nullptr, "WAIT", game_status);
-            network.wait_for_challenge(game_status);
-            std::cout << "Found Match" << std::endl;
+            std::cout << "Round " << round + 1 << ": Bye" << std::endl;
             continue;
         }
         
-        std::cout << "Found Challenger: " << challenger << std::endl;
+        std::cout << "Round " << round + 1 << ", Challenger: " << challenger << std::endl;
         
-        play(challenger);
+        play(challenger, round);
         delete[] challenger;
         
-        next_round = ttt.is_won;
-        
-        if (next_round) {
-            
-            wins = network.count_wins(game_status);
-            network.flush_game_buffer();
-            
-            if (wins == 2) {
-                next_round = false;
-                is_master = true;
-            }
-        }
+        is_master = ttt.is_won;
     }
     
-    /*
-     TODO: fix not received move
-     */
-    
-    status_listener.join();
+    {
+        // result screen
+        std::lock_guard<std::mutex> lock(ttt.mtx);
+        ttt.is_won = is_master;
+        ttt.is_over = true;
+        ttt.cv.notify_one();
+    }
     
     if (is_master) {
         network.announce_master();
         std::cout << "Starting NTP Server" << std::endl;
+        network.set_frame_report_handler([this](int64_t frame_index, int64_t swap_time) { return get_frame_skew(frame_index, swap_time); });
         network.start_ntp_server(start_time);
     } else {
         std::cout << "Wait Until NTP-Master is Determined..." << std::endl;
@@ -150,48 +141,329 @@ void SynchronizationHandler::determine_master() {
     }
 }
 
+void SynchronizationHandler::restore_master(const Roster& roster) {
+    is_restored = true;
+    set_master(roster.master);
+}
+    
+void SynchronizationHandler::set_master(in_addr_t master) {
+    
+    is_master = master == inet_addr(network.get_network_config()->address);
+    
+    if (is_master) {
+        std::cout << "Starting NTP Server" << std::endl;
+        network.set_frame_report_handler([this](int64_t frame_index, int64_t swap_time) { return get_frame_skew(frame_index, swap_time); });
+        network.start_ntp_server(start_time);
+    } else {
+        ntp_server = new char[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &master, ntp_server, INET_ADDRSTRLEN);
+        std::cout << "NTP-Master: " << ntp_server << std::endl;
+    }
+    
+    // no game, releases the render thread waiting for the first move
+    std::lock_guard<std::mutex> lock(ttt.mtx);
+    ttt.reset();
+    ttt.player = 'X';
+    ttt.is_won = is_master;
+    ttt.is_over = true;
+    ttt.new_move = true;
+    ttt.cv.notify_one();
+}
+
 bool SynchronizationHandler::get_is_master() {
     return is_master;
 }
 
+const char* SynchronizationHandler::get_master_addr() {
+    return is_master ? network.get_network_config()->address : ntp_server;
+}
+
 void SynchronizationHandler::set_offset() {
 
     if (!is_master) {
-        uint32_t offset = 0;
+        std::vector<NTPPacket> samples;
+        
+        // the clock discipline starts with the drift of the last run, the offset is all that's missing
+        size_t number_of_samples = is_restored ? NTP_BEST_SAMPLES : NTP_SAMPLES;
         
-        for (int i=0; i!=10; i++) {
+        while (samples.size() != number_of_samples) {
             NTPPacket packet;
-            std::memset(&packet, 0, NTP_PACKET_SIZE);
             
-            packet.time_request = false;
-            packet = network.request_time(ntp_server);
-            
-            uint64_t temp_offset = ((packet.req_recv_time - packet.req_trans_time) + (packet.res_recv_time - packet.res_trans_time)) / 2;
-            offset += temp_offset;
+            if (network.request_time(ntp_server, packet)) {
+                samples.push_back(packet);
+            }
             
-            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        
+        std::sort(samples.begin(), samples.end(), [](const NTPPacket& a, const NTPPacket& b) { return a.get_delay() < b.get_delay(); });
+        
+        int64_t offset = 0;
+        
+        for (int i=0; i!=NTP_BEST_SAMPLES; i++) {
+            offset += samples[i].get_offset();
         }
         
-        offset /= 10;
+        offset /= NTP_BEST_SAMPLES;
         
-        std::cout << "Average Offset: " << offset << std::endl;
+        std::cout << "Offset: " << offset / 1000 << "us (RTT " << samples[0].get_delay() / 1000 << "us)" << std::endl;
         
         this->offset = offset;
+        this->delay = samples[0].get_delay();
+        
+        // starting point of the clock discipline, skew is unknown yet
+        std::lock_guard<std::mutex> lock(clock_mutex);
+        double deviation = delay / 2.0;
+        clock_filter.reset(samples[0].res_recv_time, (double) offset, deviation * deviation, 0, ClockFilter::SKEW_VARIANCE);
+    }
+}
+
+int64_t SynchronizationHandler::get_offset() {
+    return cluster_now() - get_steady_time_ns();
+}
+
+void SynchronizationHandler::start_clock_discipline(const char* drift_path) {
+    
+    // the master's clock is the cluster clock
+    if (is_master || discipline_thread.joinable()) {
+        return;
+    }
+    
+    this->drift_path = drift_path;
+    
+    double skew_ppm;
+    
+    if (load_drift(skew_ppm)) {
+        std::lock_guard<std::mutex> lock(clock_mutex);
+        
+        if (!clock_filter.initialized) {
+            clock_filter.reset(get_steady_time_ns(), (double) offset, delay / 2.0 * delay / 2.0, 0, ClockFilter::SKEW_VARIANCE);
+        }
+        
+        // a known crystal only has to be tracked, not found (5 ppm instead of 50 ppm)
+        clock_filter.skew = skew_ppm * 1e-6;
+        clock_filter.p_skew = ClockFilter::SKEW_VARIANCE / 100;
+        
+        std::cout << "Loaded Clock Drift: " << skew_ppm << "ppm" << std::endl;
+    }
+    
+    discipline_active = true;
+    discipline_thread = std::thread(&SynchronizationHandler::discipline_clock, this);
+}
+
+void SynchronizationHandler::stop_clock_discipline() {
+    
+    {
+        std::lock_guard<std::mutex> lock(discipline_mutex);
+        discipline_active = false;
+    }
+    discipline_cv.notify_all();
+    
+    if (discipline_thread.joinable()) {
+        discipline_thread.join();
     }
 }
 
-uint32_t SynchronizationHandler::get_offset() {
-    return offset;
+// shortest round trip out of a burst of exchanges
+bool SynchronizationHandler::sample_master(NTPPacket& best) {
+    
+    bool sampled = false;
+    
+    for (int i=0; i!=DISCIPLINE_BURST; i++) {
+        NTPPacket packet;
+        
+        if (network.request_time(ntp_server, packet) && (!sampled || packet.get_delay() < best.get_delay())) {
+            best = packet;
+            sampled = true;
+        }
+        
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    
+    return sampled;
+}
+
+void SynchronizationHandler::discipline_clock() {
+    
+    int rounds = 0;
+    int64_t min_delay = delay;
+    
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(discipline_mutex);
+            discipline_cv.wait_for(lock, std::chrono::milliseconds(DISCIPLINE_INTERVAL_MS), [this] { return !discipline_active; });
+            
+            if (!discipline_active) {
+                break;
+            }
+        }
+        
+        NTPPacket sample;
+        
+        if (!sample_master(sample)) {
+            continue;
+        }
+        
+        int64_t sample_delay = sample.get_delay();
+        
+        // slowly forget the best round trip, the path can get slower for good
+        min_delay = min_delay <= 0 ? sample_delay : std::min(sample_delay, min_delay + min_delay / 64);
+        
+        // round trips far above the best one are dominated by queueing
+        if (sample_delay > 2 * min_delay + 100000) {
+            continue;
+        }
+        
+        double deviation = sample_delay / 2.0;
+        
+        {
+            std::lock_guard<std::mutex> lock(clock_mutex);
+            
+            if (clock_filter.initialized) {
+                clock_filter.update(sample.res_recv_time, (double) sample.get_offset(), deviation * deviation);
+            } else {
+                clock_filter.reset(sample.res_recv_time, (double) sample.get_offset(), deviation * deviation, 0, ClockFilter::SKEW_VARIANCE);
+            }
+        }
+        
+        if (++rounds % DRIFT_SAVE_ROUNDS == 0) {
+            save_drift();
+        }
+        
+        send_frame_report();
+    }
+    
+    if (rounds >= DRIFT_SAVE_ROUNDS) {
+        save_drift();
+    }
+}
+
+void SynchronizationHandler::report_swap(int64_t frame_index, int64_t swap_time, int64_t frame_duration) {
+    std::lock_guard<std::mutex> lock(frame_mutex);
+    last_frame_index = frame_index;
+    last_swap_time = swap_time;
+    this->frame_duration = frame_duration;
+}
+
+int64_t SynchronizationHandler::take_skew_correction() {
+    return pending_skew.exchange(0);
+}
+
+// master side, compares the node's swap with where the master's own swaps put that frame
+int64_t SynchronizationHandler::get_frame_skew(int64_t frame_index, int64_t swap_time) {
+    
+    std::lock_guard<std::mutex> lock(frame_mutex);
+    
+    if (last_frame_index < 0 || frame_duration == 0) {
+        return 0;
+    }
+    
+    int64_t expected_swap_time = last_swap_time + (frame_index - last_frame_index) * frame_duration;
+    
+    return swap_time - expected_swap_time;
+}
+
+void SynchronizationHandler::send_frame_report() {
+    
+    // the last correction has to show up in the swaps before it is measured again
+    if (pending_skew != 0) {
+        return;
+    }
+    
+    int64_t frame_index, swap_time;
+    
+    {
+        std::lock_guard<std::mutex> lock(frame_mutex);
+        frame_index = last_frame_index;
+        swap_time = last_swap_time;
+    }
+    
+    int64_t skew;
+    
+    if (frame_index < 0 || !network.report_frame(ntp_server, frame_index, swap_time, skew)) {
+        return;
+    }
+    
+    if (std::abs(skew) > SKEW_TOLERANCE_NS) {
+        std::cout << "Frame Skew: " << skew / 1000 << "us at frame " << frame_index << std::endl;
+        pending_skew = skew;
+    }
 }
 
-uint32_t SynchronizationHandler::get_start_time() {
+int64_t SynchronizationHandler::cluster_now() const {
+    
+    int64_t local_time = get_steady_time_ns();
     
     if (is_master) {
+        return local_time;
+    }
+    
+    std::lock_guard<std::mutex> lock(clock_mutex);
+    
+    if (!clock_filter.initialized) {
+        return local_time + offset;
+    }
+    
+    return local_time + clock_filter.get_offset(local_time);
+}
+
+double SynchronizationHandler::get_skew_ppm() const {
+    std::lock_guard<std::mutex> lock(clock_mutex);
+    return clock_filter.skew * 1e6;
+}
+
+bool SynchronizationHandler::load_drift(double& skew_ppm) {
+    
+    if (drift_path == nullptr) {
+        return false;
+    }
+    
+    std::ifstream file_stream(drift_path);
+    
+    // anything beyond a few hundred ppm isn't a crystal, rather a broken file
+    if (!(file_stream >> skew_ppm) || std::abs(skew_ppm) > 500) {
+        return false;
+    }
+    
+    return true;
+}
+
+void SynchronizationHandler::save_drift() {
+    
+    if (drift_path == nullptr) {
+        return;
+    }
+    
+    std::ofstream file_stream(drift_path, std::ofstream::trunc);
+    file_stream << get_skew_ppm() << std::endl;
+    
+    if (!file_stream) {
+        std::cerr << "Failed to write clock drift file: " << drift_path << std::endl;
+    }
+}
+
+int64_t SynchronizationHandler::get_start_time() {
+    
+    if (is_master) {
+        network.report_primed();
+        
         while (start_time == 0) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
         }
         return start_time;
     }
     
     return network.request_start_time(ntp_server);
 }
+
+void SynchronizationHandler::wait_until(int64_t cluster_time) const {
+    
+    // sleeps wake up late by up to the scheduler granularity, so stop short of the deadline
+    int64_t remaining = cluster_time - cluster_now();
+    
+    if (remaining > SPIN_TAIL_NS) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(remaining - SPIN_TAIL_NS));
+    }
+    
+    while (cluster_now() < cluster_time) {}
+}
@@ -10,19 +10,136 @@
 
 #include "network.h"
 
+#include <fstream>
+#include <cmath>
+
+enum ElectionStrategy {
+    // tic-tac-toe games shown on the wall, the winner of the tournament is master
+    ELECTION_TOURNAMENT,
+    // one round of votes for the lowest address, nothing to show
+    ELECTION_LOWEST_ADDRESS
+};
+
 class SynchronizationHandler {
 private:
     Network& network;
     
-    char** game_status;
-    
     std::thread handler_thread;
     
     bool is_master;
     char* ntp_server;
+    // master taken over from a validated roster, the drift to it is known already
+    bool is_restored;
+    
+    // start instant on the cluster clock in ns, 0 until the master picked it
+    std::atomic<int64_t> start_time;
+    
+    // master clock minus local steady clock and round trip of the best sample, in ns
+    int64_t offset;
+    int64_t delay;
+    
+    static constexpr int NTP_SAMPLES = 16;
+    // samples with the shortest round trips, queueing only ever adds error
+    static constexpr int NTP_BEST_SAMPLES = 4;
+    
+    // exchanges per discipline round, the one with the shortest round trip is used
+    static constexpr int DISCIPLINE_BURST = 4;
+    static constexpr int DISCIPLINE_INTERVAL_MS = 1000;
+    // rounds between writes of the learned skew
+    static constexpr int DRIFT_SAVE_ROUNDS = 60;
+    // wait_until() sleeps until this close to the deadline and spins the rest
+    static constexpr int64_t SPIN_TAIL_NS = 2000000;
+    // skew below this is left alone, correcting it would only add jitter
+    static constexpr int64_t SKEW_TOLERANCE_NS = 1000000;
+    
+    // latest swap of this node, reported to the master (or compared against on the master)
+    std::mutex frame_mutex;
+    int64_t last_frame_index = -1;
+    int64_t last_swap_time = 0;
+    int64_t frame_duration = 0;
+    
+    // measured skew the render loop hasn't applied yet
+    std::atomic<int64_t> pending_skew;
+    
+    int64_t get_frame_skew(int64_t frame_index, int64_t swap_time);
+    void send_frame_report();
+    
+    // two state kalman filter over the master offset and its drift (skew)
+    //
+    // offset(t) = offset + skew * (t - reference_time), t on the local steady clock in ns
+    struct ClockFilter {
+        double offset = 0;
+        double skew = 0;
+        int64_t reference_time = 0;
+        bool initialized = false;
+        
+        // covariance of offset and skew
+        double p_offset = 0;
+        double p_cross = 0;
+        double p_skew = 0;
+        
+        // white phase noise and frequency random walk, per ns of elapsed time
+        static constexpr double Q_OFFSET = 1e-3;
+        static constexpr double Q_SKEW = 1e-27;
+        // prior on the skew of a crystal (50 ppm)
+        static constexpr double SKEW_VARIANCE = 2.5e-9;
+        
+        void reset(int64_t local_time, double measured_offset, double variance, double prior_skew, double skew_variance) {
+            offset = measured_offset;
+            skew = prior_skew;
+            reference_time = local_time;
+            p_offset = variance;
+            p_cross = 0;
+            p_skew = skew_variance;
+            initialized = true;
+        }
+        
+        void update(int64_t local_time, double measured_offset, double variance) {
+            
+            double dt = (double) (local_time - reference_time);
+            
+            // predict to the time of the measurement
+            offset += skew * dt;
+            p_offset += dt * (2 * p_cross + dt * p_skew) + Q_OFFSET * dt;
+            p_cross += dt * p_skew;
+            p_skew += Q_SKEW * dt;
+            
+            // correct
+            double innovation = measured_offset - offset;
+            double gain_offset = p_offset / (p_offset + variance);
+            double gain_skew = p_cross / (p_offset + variance);
+            
+            offset += gain_offset * innovation;
+            skew += gain_skew * innovation;
+            
+            p_skew -= gain_skew * p_cross;
+            p_cross -= gain_offset * p_cross;
+            p_offset -= gain_offset * p_offset;
+            
+            reference_time = local_time;
+        }
+        
+        int64_t get_offset(int64_t local_time) const {
+            return (int64_t) (offset + skew * (double) (local_time - reference_time));
+        }
+    };
+    
+    ClockFilter clock_filter;
+    mutable std::mutex clock_mutex;
     
-    uint32_t start_time;
-    uint32_t offset;
+    std::thread discipline_thread;
+    std::mutex discipline_mutex;
+    std::condition_variable discipline_cv;
+    bool discipline_active = false;
+    const char* drift_path = nullptr;
+    
+    // takes master as the ntp master and releases the render thread waiting for a game
+    void set_master(in_addr_t master);
+    
+    void discipline_clock();
+    bool sample_master(NTPPacket& best);
+    bool load_drift(double& skew_ppm);
+    void save_drift();
     
     struct tic_tac_toe {
         
@@ -130,15 +247,36 @@ private:
     
 public:
     SynchronizationHandler(Network& network);
+    ~SynchronizationHandler();
     
     tic_tac_toe ttt;
     
-    void play(char*);
-    void determine_master();
+    // one match of the tournament, replayed until it isn't a draw
+    void play(char* challenger, int round);
+    // every node has to use the same strategy
+    void determine_master(ElectionStrategy strategy = ELECTION_TOURNAMENT);
+    // takes the master of a validated roster instead of determine_master()
+    void restore_master(const Roster& roster);
     bool get_is_master();
+    const char* get_master_addr();
     void set_offset();
-    uint32_t get_offset();
-    uint32_t get_start_time();
+    int64_t get_offset();
+    
+    // keeps following the master in the background, the learned skew is kept in drift_path
+    void start_clock_discipline(const char* drift_path);
+    void stop_clock_discipline();
+    // master clock in ns on the local steady clock timeline, use for all playback scheduling
+    int64_t cluster_now() const;
+    double get_skew_ppm() const;
+    // reports this node's buffers as primed, blocks until the master announces the start
+    int64_t get_start_time();
+    // coarse sleep followed by a spin until cluster_now() reaches cluster_time
+    void wait_until(int64_t cluster_time) const;
+    
+    // called after every swap, swap_time on the cluster clock
+    void report_swap(int64_t frame_index, int64_t swap_time, int64_t frame_duration);
+    // skew against the master in ns, late nodes get a positive value, 0 once taken
+    int64_t take_skew_correction();
     
 
     
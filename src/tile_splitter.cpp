@@ -0,0 +1,274 @@
+//
+//  tile_splitter.cpp
+//  vibes
+//
+//  Created by Justus Stahlhut on 18.10.26.
+//
+//  vibes-tile <wall video> [layout] [gop size] [encoder]
+//
+//  re-encodes the wall video into one file per position (get_tile_path()),
+//  so every node only decodes its own tile. keyframes are forced on the same
+//  frames in every tile and the source timestamps are kept, so the tiles stay
+//  interchangeable frame by frame.
+//
+
+#include <vector>
+
+#include "video_reader.hpp"
+
+struct TileEncoder {
+    std::string path;
+    AVFormatContext* format_ctx = nullptr;
+    AVCodecContext* codec_ctx = nullptr;
+    AVStream* stream = nullptr;
+    AVFrame* frame = nullptr;
+    AVPacket* packet = nullptr;
+    bool opened = false;
+};
+
+static bool open_tile(TileEncoder &tile, VideoReaderContext &source, AVPixelFormat pix_fmt, int gop_size, const char *encoder_name) {
+    
+    const AVCodec *codec = avcodec_find_encoder_by_name(encoder_name);
+    
+    if (!codec) {
+        codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+    }
+    
+    if (!codec) {
+        std::cerr << "Couldn't find encoder " << encoder_name << std::endl;
+        return false;
+    }
+    
+    if (avformat_alloc_output_context2(&tile.format_ctx, NULL, NULL, tile.path.c_str()) < 0) {
+        std::cerr << "Couldn't allocate output context for " << tile.path << std::endl;
+        return false;
+    }
+    
+    tile.stream = avformat_new_stream(tile.format_ctx, NULL);
+    tile.codec_ctx = avcodec_alloc_context3(codec);
+    
+    if (!tile.stream || !tile.codec_ctx) {
+        std::cerr << "Couldn't allocate encoder for " << tile.path << std::endl;
+        return false;
+    }
+    
+    AVStream *source_stream = source.format_ctx->streams[source.video_stream_index];
+    
+    tile.codec_ctx->width = source.width;
+    tile.codec_ctx->height = source.height;
+    tile.codec_ctx->pix_fmt = pix_fmt;
+    tile.codec_ctx->time_base = source.time_base;
+    tile.codec_ctx->framerate = av_guess_frame_rate(source.format_ctx, source_stream, NULL);
+    
+    // fixed, closed GOPs without B-frames, keyframes are forced in encode_tiles()
+    tile.codec_ctx->gop_size = gop_size;
+    tile.codec_ctx->keyint_min = gop_size;
+    tile.codec_ctx->max_b_frames = 0;
+    tile.codec_ctx->flags |= AV_CODEC_FLAG_CLOSED_GOP;
+    
+    if (source.codec_params->bit_rate > 0) {
+        tile.codec_ctx->bit_rate = source.codec_params->bit_rate / source.layout.get_number_of_positions();
+    }
+    
+    if (tile.format_ctx->oformat->flags & AVFMT_GLOBALHEADER) {
+        tile.codec_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+    
+    // scene cuts would give every tile its own GOP boundaries, ignored by other encoders
+    av_opt_set(tile.codec_ctx->priv_data, "x264-params", "scenecut=0", 0);
+    av_opt_set(tile.codec_ctx->priv_data, "forced-idr", "1", 0);
+    
+    if (avcodec_open2(tile.codec_ctx, codec, NULL) < 0) {
+        std::cerr << "Couldn't open encoder for " << tile.path << std::endl;
+        return false;
+    }
+    
+    if (avcodec_parameters_from_context(tile.stream->codecpar, tile.codec_ctx) < 0) {
+        std::cerr << "Couldn't copy encoder parameters for " << tile.path << std::endl;
+        return false;
+    }
+    
+    tile.stream->time_base = tile.codec_ctx->time_base;
+    
+    if (!(tile.format_ctx->oformat->flags & AVFMT_NOFILE) && avio_open(&tile.format_ctx->pb, tile.path.c_str(), AVIO_FLAG_WRITE) < 0) {
+        std::cerr << "Couldn't open " << tile.path << std::endl;
+        return false;
+    }
+    
+    if (avformat_write_header(tile.format_ctx, NULL) < 0) {
+        std::cerr << "Couldn't write header of " << tile.path << std::endl;
+        return false;
+    }
+    
+    tile.frame = av_frame_alloc();
+    tile.packet = av_packet_alloc();
+    
+    if (!tile.frame || !tile.packet) {
+        std::cerr << "Couldn't allocate frame" << std::endl;
+        return false;
+    }
+    
+    tile.opened = true;
+    
+    return true;
+}
+
+// moves every packet the encoder has ready into the file
+static bool write_packets(TileEncoder &tile) {
+    
+    while (true) {
+        int response = avcodec_receive_packet(tile.codec_ctx, tile.packet);
+        
+        if (response == AVERROR(EAGAIN) || response == AVERROR_EOF) {
+            return true;
+        }
+        
+        if (response < 0) {
+            std::cerr << "Couldn't encode frame of " << tile.path << std::endl;
+            return false;
+        }
+        
+        av_packet_rescale_ts(tile.packet, tile.codec_ctx->time_base, tile.stream->time_base);
+        tile.packet->stream_index = tile.stream->index;
+        
+        // takes ownership of the packet data
+        if (av_interleaved_write_frame(tile.format_ctx, tile.packet) < 0) {
+            std::cerr << "Couldn't write packet to " << tile.path << std::endl;
+            return false;
+        }
+    }
+}
+
+static bool close_tile(TileEncoder &tile) {
+    
+    bool written = true;
+    
+    if (tile.opened) {
+        // flush the frames the encoder still holds
+        avcodec_send_frame(tile.codec_ctx, NULL);
+        written = write_packets(tile) && av_write_trailer(tile.format_ctx) == 0;
+    }
+    
+    if (tile.format_ctx && !(tile.format_ctx->oformat->flags & AVFMT_NOFILE)) {
+        avio_closep(&tile.format_ctx->pb);
+    }
+    
+    avformat_free_context(tile.format_ctx);
+    avcodec_free_context(&tile.codec_ctx);
+    av_frame_free(&tile.frame);
+    av_packet_free(&tile.packet);
+    
+    return written;
+}
+
+static bool encode_tiles(VideoReaderContext &source, std::vector<TileEncoder> &tiles, int gop_size, const char *encoder_name) {
+    
+    int64_t frame_index = 0;
+    
+    while (decode_frame(&source)) {
+        
+        AVFrame *frame = source.frame;
+        AVPixelFormat pix_fmt = (AVPixelFormat) frame->format;
+        
+        // pixel format is only known after the first decoded frame
+        if (frame_index == 0) {
+            for (int position=0; position!=tiles.size(); position++) {
+                if (!open_tile(tiles[position], source, pix_fmt, gop_size, encoder_name)) {
+                    return false;
+                }
+            }
+        }
+        
+        for (int position=0; position!=tiles.size(); position++) {
+            
+            TileEncoder &tile = tiles[position];
+            TileRect rect = source.layout.get_tile(position, frame->width, frame->height);
+            const uint8_t *crop_data[4];
+            
+            if (!offset_planes(frame, pix_fmt, rect.x, rect.y, crop_data)) {
+                return false;
+            }
+            
+            // points into the decoded frame, the encoder copies what it keeps
+            for (int i=0; i!=4; i++) {
+                tile.frame->data[i] = (uint8_t*) crop_data[i];
+                tile.frame->linesize[i] = frame->linesize[i];
+            }
+            
+            tile.frame->width = source.width;
+            tile.frame->height = source.height;
+            tile.frame->format = pix_fmt;
+            tile.frame->pts = frame->pts;
+            tile.frame->pict_type = frame_index % gop_size == 0 ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+            
+            if (avcodec_send_frame(tile.codec_ctx, tile.frame) < 0) {
+                std::cerr << "Couldn't send frame to encoder of " << tile.path << std::endl;
+                return false;
+            }
+            
+            if (!write_packets(tile)) {
+                return false;
+            }
+        }
+        
+        frame_index++;
+    }
+    
+    std::cout << "Encoded " << frame_index << " frames per tile" << std::endl;
+    
+    return source.end_of_file;
+}
+
+int main(int argc, const char * argv[]) {
+    
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <wall video> [layout] [gop size] [encoder]" << std::endl;
+        return 1;
+    }
+    
+    const char *encoder_name = argc > 4 ? argv[4] : "libx264";
+    
+    VideoReaderContext source;
+    source.position = 0;
+    
+    if (argc > 2 && !WallLayout::parse(argv[2], source.layout)) {
+        std::cerr << "Invalid wall layout " << argv[2] << std::endl;
+        return 1;
+    }
+    
+    source.config.source_mode = SOURCE_SPLIT;
+    
+    if (!open_video_reader(argv[1], &source)) {
+        return 1;
+    }
+    
+    // one second of frames unless given
+    AVRational frame_rate = av_guess_frame_rate(source.format_ctx, source.format_ctx->streams[source.video_stream_index], NULL);
+    int gop_size = argc > 3 ? std::stoi(argv[3]) : (frame_rate.den > 0 ? (frame_rate.num + frame_rate.den - 1) / frame_rate.den : 30);
+    
+    if (gop_size < 1) {
+        std::cerr << "GOP size has to be positive" << std::endl;
+        close_reader(&source);
+        return 1;
+    }
+    
+    std::vector<TileEncoder> tiles(source.layout.get_number_of_positions());
+    
+    for (int position=0; position!=tiles.size(); position++) {
+        tiles[position].path = get_tile_path(argv[1], source.layout, position);
+    }
+    
+    bool encoded = encode_tiles(source, tiles, gop_size, encoder_name);
+    
+    for (int position=0; position!=tiles.size(); position++) {
+        if (!close_tile(tiles[position])) {
+            encoded = false;
+        } else if (encoded) {
+            std::cout << "\t" << tiles[position].path << std::endl;
+        }
+    }
+    
+    close_reader(&source);
+    
+    return encoded ? 0 : 1;
+}
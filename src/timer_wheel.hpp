@@ -0,0 +1,113 @@
+//
+//  timer_wheel.hpp
+//  vibes
+//
+//  Created by Justus Stahlhut on 18.10.26.
+//
+
+#ifndef timer_wheel_hpp
+#define timer_wheel_hpp
+
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+
+// hashed timer wheel, one slot per tick
+//
+// scheduling and expiring are O(1) per entry, entries more than a revolution
+// ahead stay in their slot until their tick comes around. entries can't be
+// cancelled, the owner ignores the ones that are no longer of interest.
+// not synchronized, the owner locks.
+template <typename T>
+class TimerWheel {
+private:
+    struct Entry {
+        uint64_t tick;
+        T value;
+    };
+    
+    const std::chrono::nanoseconds tick_duration;
+    const std::chrono::steady_clock::time_point origin;
+    std::vector<std::vector<Entry>> slots;
+    std::vector<T> expired;
+    // last tick that has been processed
+    uint64_t current_tick = 0;
+    size_t number_of_entries = 0;
+    
+    uint64_t get_tick(std::chrono::steady_clock::time_point time) const {
+        
+        if (time <= origin) {
+            return 0;
+        }
+        
+        return (uint64_t) ((time - origin) / tick_duration);
+    }
+
+public:
+    TimerWheel(std::chrono::nanoseconds tick_duration, size_t number_of_slots) : tick_duration(tick_duration), origin(std::chrono::steady_clock::now()), slots(number_of_slots) {}
+    
+    // fires on the first tick at or after deadline, never on the current one
+    void schedule(T value, std::chrono::steady_clock::time_point deadline) {
+        
+        uint64_t tick = get_tick(deadline + tick_duration - std::chrono::nanoseconds(1));
+        
+        if (tick <= current_tick) {
+            tick = current_tick + 1;
+        }
+        
+        slots[tick % slots.size()].push_back({tick, std::move(value)});
+        number_of_entries++;
+    }
+    
+    // calls expire for every entry due until now, expire may schedule again
+    template <typename F>
+    void advance(std::chrono::steady_clock::time_point now, F&& expire) {
+        
+        uint64_t target = get_tick(now);
+        
+        // nothing to walk over after an idle period
+        if (number_of_entries == 0) {
+            current_tick = std::max(current_tick, target);
+            return;
+        }
+        
+        while (current_tick < target) {
+            
+            current_tick++;
+            std::vector<Entry>& slot = slots[current_tick % slots.size()];
+            
+            for (size_t i=0; i<slot.size();) {
+                if (slot[i].tick <= current_tick) {
+                    expired.push_back(std::move(slot[i].value));
+                    slot[i] = std::move(slot.back());
+                    slot.pop_back();
+                    number_of_entries--;
+                } else {
+                    i++;
+                }
+            }
+        }
+        
+        for (T& value : expired) {
+            expire(value);
+        }
+        
+        expired.clear();
+    }
+    
+    bool empty() const {
+        return number_of_entries == 0;
+    }
+    
+    size_t size() const {
+        return number_of_entries;
+    }
+    
+    std::chrono::nanoseconds get_tick_duration() const {
+        return tick_duration;
+    }
+};
+
+#endif /* timer_wheel_hpp */
@@ -7,14 +7,117 @@
 
 #include "video_reader.hpp"
 
+#include <chrono>
+
+bool PacketQueue::push(AVPacket* packet) {
+    
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait(lock, [this] { return packets.size() < capacity || aborted; });
+    
+    if (aborted) {
+        return false;
+    }
+    
+    packets.push_back(packet);
+    cv.notify_all();
+    
+    return true;
+}
+
+AVPacket* PacketQueue::pop() {
+    
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait(lock, [this] { return !packets.empty() || end_of_stream || aborted; });
+    
+    if (packets.empty()) {
+        return nullptr;
+    }
+    
+    AVPacket* packet = packets.front();
+    packets.pop_front();
+    cv.notify_all();
+    
+    return packet;
+}
+
+void PacketQueue::finish() {
+    std::lock_guard<std::mutex> lock(mtx);
+    end_of_stream = true;
+    cv.notify_all();
+}
+
+void PacketQueue::abort() {
+    std::lock_guard<std::mutex> lock(mtx);
+    aborted = true;
+    cv.notify_all();
+}
+
+void PacketQueue::clear() {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (AVPacket* packet : packets) {
+        av_packet_free(&packet);
+    }
+    packets.clear();
+}
+
+// reads packets ahead on its own thread so disk I/O overlaps decoding
+static void demux_packets(VideoReaderContext *video_ctx) {
+    
+    auto &format_ctx = video_ctx->format_ctx;
+    int &video_stream_index = video_ctx->video_stream_index;
+    auto &packet_queue = video_ctx->packet_queue;
+    
+    while (true) {
+        AVPacket *packet = av_packet_alloc();
+        
+        if (!packet) {
+            std::cerr << "Couldn't allocate packet" << std::endl;
+            break;
+        }
+        
+        if (av_read_frame(format_ctx, packet) < 0) {
+            av_packet_free(&packet);
+            break;
+        }
+        
+        if (packet->stream_index != video_stream_index) {
+            av_packet_free(&packet);
+            continue;
+        }
+        
+        if (!packet_queue.push(packet)) {
+            av_packet_free(&packet);
+            break;
+        }
+    }
+    
+    packet_queue.finish();
+}
+
+// video_split.mov -> video_split_2x2_tile0.mov, the layout keeps a node from opening a tile of another split
+std::string get_tile_path(const char *filename, const WallLayout &layout, short position) {
+    
+    std::string path = filename;
+    size_t extension = path.find_last_of('.');
+    size_t separator = path.find_last_of('/');
+    
+    if (extension == std::string::npos || (separator != std::string::npos && extension < separator)) {
+        extension = path.size();
+    }
+    
+    return path.substr(0, extension) + "_" + layout.to_string() + "_tile" + std::to_string(position) + path.substr(extension);
+}
+
 bool open_video_reader(const char *filename, VideoReaderContext *video_ctx) {
     
     int &width = video_ctx->width;
     int &height = video_ctx->height;
     short &position = video_ctx->position;
+    WallLayout &layout = video_ctx->layout;
     
     int &rgb_frame_size = video_ctx->rgb_frame_size;
     AVRational &time_base = video_ctx->time_base;
+    AVRational &frame_rate = video_ctx->frame_rate;
     auto &format_ctx = video_ctx->format_ctx;
     auto &codec_ctx = video_ctx->codec_ctx;
     auto &codec_params = video_ctx->codec_params;
@@ -26,8 +129,10 @@ bool open_video_reader(const char *filename, VideoReaderContext *video_ctx) {
     auto &filter_inputs = video_ctx->filter_inputs;
     auto &filter_outputs = video_ctx->filter_outputs;
     
-    auto &packet = video_ctx->packet;
     auto &frame = video_ctx->frame;
+    bool &tiled = video_ctx->tiled;
+    
+    ReaderConfig &config = video_ctx->config;
     
     format_ctx = avformat_alloc_context();
     
@@ -39,13 +144,32 @@ bool open_video_reader(const char *filename, VideoReaderContext *video_ctx) {
         return false;
     }
     
-    if (avformat_open_input(&format_ctx, filename, NULL, NULL) != 0) {
+    tiled = false;
+    
+    if (position < 0 || position >= layout.get_number_of_positions()) {
+        std::cerr << "Position " << position << " isn't part of the " << layout.to_string() << " wall" << std::endl;
+        return false;
+    }
+    
+    if (config.source_mode == SOURCE_TILE) {
+        std::string tile_path = get_tile_path(filename, layout, position);
+        
+        // a failed open frees the context and leaves format_ctx NULL
+        if (avformat_open_input(&format_ctx, tile_path.c_str(), NULL, NULL) == 0) {
+            tiled = true;
+        } else {
+            std::cerr << "Couldn't open tile " << tile_path << ", cropping " << filename << " instead" << std::endl;
+        }
+    }
+    
+    if (!tiled && avformat_open_input(&format_ctx, filename, NULL, NULL) != 0) {
         std::cerr << "Couldn't open file" << std::endl;
         return false;
     }
     
     video_stream_index = -1;
     const AVCodec *codec;
+    TileRect tile;
     
     for (int i=0; i!=format_ctx->nb_streams; i++) {
         
@@ -58,12 +182,13 @@ bool open_video_reader(const char *filename, VideoReaderContext *video_ctx) {
         }
         
         if (codec_params->codec_type == AVMEDIA_TYPE_VIDEO) {
-            // read video holds 2 x 2 videoså
-            width = codec_params->width / 2;
-            height = codec_params->height / 2;
-            rgb_frame_size = width * height * 4;
+            // read video holds the whole wall, a tile file only this position
+            tile = layout.get_tile(position, codec_params->width, codec_params->height);
+            width = tiled ? codec_params->width : tile.width;
+            height = tiled ? codec_params->height : tile.height;
             video_stream_index = i;
-            time_base = stream[i].time_base;
+            time_base = stream->time_base;
+            frame_rate = av_guess_frame_rate(format_ctx, stream, NULL);
             break;
         }
     }
@@ -85,37 +210,54 @@ bool open_video_reader(const char *filename, VideoReaderContext *video_ctx) {
         return false;
     }
     
+    codec_ctx->thread_count = config.thread_count;
+    codec_ctx->thread_type = config.thread_type;
+    
+    if (config.low_delay) {
+        codec_ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    }
+    
     if (avcodec_open2(codec_ctx, codec, NULL) < 0) {
         std::cerr << "Couldn't open Codec" << std::endl;
         return false;
     }
     
-    filter_graph = avfilter_graph_alloc();
+    video_ctx->crop_x = tiled ? 0 : tile.x;
+    video_ctx->crop_y = tiled ? 0 : tile.y;
     
-    char args[512];
-    snprintf(args, sizeof(args), "buffer=video_size=%dx%d:pix_fmt=%d:time_base=1/1:pixel_aspect=0/1[in];"
-                                 "[in]crop=out_w=%d:out_h=%d:x=%d:y=%d[out];"
-                                 "[out]buffersink", 2 * width, 2 * height, AV_PIX_FMT_YUV420P, width, height, width * (position % 2), height * (position > 1));
+    filter_graph = nullptr;
     
-    if (avfilter_graph_parse2(filter_graph, args, &filter_inputs, &filter_outputs) < 0) {
-        std::cerr << "Couldn't parse filter graph: " << strerror(errno) << std::endl;
-        return false;
+    if (!tiled && config.crop_mode == CROP_FILTER_GRAPH) {
+        
+        filter_graph = avfilter_graph_alloc();
+        
+        char args[512];
+        snprintf(args, sizeof(args), "buffer=video_size=%dx%d:pix_fmt=%d:time_base=1/1:pixel_aspect=0/1[in];"
+                                     "[in]crop=out_w=%d:out_h=%d:x=%d:y=%d[out];"
+                                     "[out]buffersink", codec_params->width, codec_params->height, AV_PIX_FMT_YUV420P, width, height, video_ctx->crop_x, video_ctx->crop_y);
+        
+        if (avfilter_graph_parse2(filter_graph, args, &filter_inputs, &filter_outputs) < 0) {
+            std::cerr << "Couldn't parse filter graph: " << strerror(errno) << std::endl;
+            return false;
+        }
+        
+        if (avfilter_graph_config(filter_graph, NULL) < 0) {
+            std::cerr << "Couldn't set filter graph config: " << strerror(errno) << std::endl;
+            return false;
+        }
+        
+        buffersrc_ctx = avfilter_graph_get_filter(filter_graph, "Parsed_buffer_0");
+        buffersink_ctx = avfilter_graph_get_filter(filter_graph, "Parsed_buffersink_2");
     }
     
-    if (avfilter_graph_config(filter_graph, NULL) < 0) {
-        std::cerr << "Couldn't set filter graph config: " << strerror(errno) << std::endl;
-        return false;
+    // converter can be plugged in before opening the reader
+    if (!video_ctx->converter && config.output_format == OUTPUT_YUV420P) {
+        video_ctx->converter = new PlanarColorConverter(config.conversion_threads);
+    } else if (!video_ctx->converter) {
+        video_ctx->converter = new SwsColorConverter(AV_PIX_FMT_RGB0, config.conversion_threads);
     }
     
-    buffersrc_ctx = avfilter_graph_get_filter(filter_graph, "Parsed_buffer_0");
-    buffersink_ctx = avfilter_graph_get_filter(filter_graph, "Parsed_buffersink_2");
-    
-    packet = av_packet_alloc();
-    
-    if (!packet) {
-        std::cerr << "Couldn't allocate packet" << std::endl;
-        return false;
-    }
+    rgb_frame_size = video_ctx->converter->get_frame_size(width, height);
     
     // Frame holding cropped image
     frame = av_frame_alloc();
@@ -125,21 +267,57 @@ bool open_video_reader(const char *filename, VideoReaderContext *video_ctx) {
         return false;
     }
     
+    video_ctx->packet_queue.capacity = config.packet_queue_size;
+    video_ctx->demux_thread = std::thread(demux_packets, video_ctx);
+    
     return true;
 }
 
-int read_frame_and_set_flag(VideoReaderContext *video_ctx) {
+// decodes the next video frame into video_ctx->frame
+bool decode_frame(VideoReaderContext *video_ctx) {
     
-    auto &format_ctx = video_ctx->format_ctx;
-    auto &packet = video_ctx->packet;
+    auto &codec_ctx = video_ctx->codec_ctx;
+    auto &packet_queue = video_ctx->packet_queue;
+    auto &frame = video_ctx->frame;
     
-    int response = av_read_frame(format_ctx, packet);
+    char error_buffer[AV_ERROR_MAX_STRING_SIZE];
     
-    if (response < 0) {
-        video_ctx->end_of_file = true;
+    while (true) {
+        
+        // frame threading holds back frames, so collect buffered ones before sending more packets
+        int response = avcodec_receive_frame(codec_ctx, frame);
+        
+        if (response == 0) {
+            return true;
+        }
+        
+        if (response == AVERROR_EOF) {
+            video_ctx->end_of_file = true;
+            return false;
+        }
+        
+        if (response != AVERROR(EAGAIN)) {
+            std::cerr << "Failed to decode packet: " << av_make_error_string(error_buffer, AV_ERROR_MAX_STRING_SIZE, response) << std::endl;
+            return false;
+        }
+        
+        AVPacket *packet = packet_queue.pop();
+        
+        if (!packet) {
+            // end of stream, flush the delayed frames out of the decoder
+            avcodec_send_packet(codec_ctx, NULL);
+            continue;
+        }
+        
+        // decoder output has been drained above, so the packet is always accepted
+        response = avcodec_send_packet(codec_ctx, packet);
+        av_packet_free(&packet);
+        
+        if (response < 0) {
+            std::cerr << "Couldn't decode packet: " << av_make_error_string(error_buffer, AV_ERROR_MAX_STRING_SIZE, response) << std::endl;
+            return false;
+        }
     }
-    
-    return response;
 }
 
 static AVPixelFormat correct_deprecated_format(AVPixelFormat pix_fmt) {
@@ -157,88 +335,157 @@ static AVPixelFormat correct_deprecated_format(AVPixelFormat pix_fmt) {
     }
 }
 
-bool read_frame(VideoReaderContext *video_ctx, uint8_t *frame_buffer, int64_t *pts) {
-    
-    auto &codec_ctx = video_ctx->codec_ctx;
-    int &video_stream_index = video_ctx->video_stream_index;
+// points crop_data at the tile inside the decoded frame without copying
+bool offset_planes(AVFrame *frame, AVPixelFormat pix_fmt, int x, int y, const uint8_t *crop_data[4]) {
     
-    auto &buffersrc_ctx = video_ctx->buffersrc_ctx;
-    auto &buffersink_ctx = video_ctx->buffersink_ctx;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pix_fmt);
     
-    auto &scaler_ctx = video_ctx->scaler_ctx;
-    auto &packet = video_ctx->packet;
-    auto &frame = video_ctx->frame;
+    if (!desc || !(desc->flags & AV_PIX_FMT_FLAG_PLANAR)) {
+        std::cerr << "Plane offset crop needs a planar pixel format" << std::endl;
+        return false;
+    }
     
-    int response;
-    char *error_buffer = new char[256];
+    // chroma planes can only be cut at subsampled positions
+    x &= ~((1 << desc->log2_chroma_w) - 1);
+    y &= ~((1 << desc->log2_chroma_h) - 1);
     
-    while (read_frame_and_set_flag(video_ctx) >= 0) {
-        if (packet->stream_index != video_stream_index) {
-            av_packet_unref(packet);
+    for (int i=0; i!=4; i++) {
+        if (!frame->data[i]) {
+            crop_data[i] = NULL;
             continue;
         }
         
-        response = avcodec_send_packet(codec_ctx, packet);
-        
-        if (response < 0) {
-            std::cout << "Couldn't decode packet " << av_make_error_string(error_buffer, 256, response) << std::endl;
-            return false;
-        }
+        bool is_chroma = i == 1 || i == 2;
+        int plane_x = is_chroma ? x >> desc->log2_chroma_w : x;
+        int plane_y = is_chroma ? y >> desc->log2_chroma_h : y;
         
-        response = avcodec_receive_frame(codec_ctx, frame);
+        // bytes per pixel of the plane, 2 for >8 bit samples and for interleaved chroma (nv12)
+        int step = 1;
         
-        if (response == AVERROR(EAGAIN) || response == AVERROR_EOF) {
-            continue;
-        } else if (response < 0) {
-            delete[](error_buffer);
-            std::cout << "Failed to decode packet." << std::endl;
-            return false;
+        for (int c=0; c!=desc->nb_components; c++) {
+            if (desc->comp[c].plane == i) {
+                step = std::max(step, desc->comp[c].step);
+            }
         }
         
-        av_packet_unref(packet);
-        break;
+        crop_data[i] = frame->data[i] + plane_y * frame->linesize[i] + plane_x * step;
     }
     
-    delete[](error_buffer);
+    return true;
+}
+
+bool read_frame(VideoReaderContext *video_ctx, uint8_t *frame_buffer, int64_t *pts) {
     
-    if (av_buffersrc_add_frame(buffersrc_ctx, frame) < 0) {
-        std::cerr << "Couldn't add frame to buffersrc: " << strerror(errno) << std::endl;
-        return false;
-    }
+    auto &codec_ctx = video_ctx->codec_ctx;
+    
+    auto &buffersrc_ctx = video_ctx->buffersrc_ctx;
+    auto &buffersink_ctx = video_ctx->buffersink_ctx;
     
-    if (av_buffersink_get_frame(buffersink_ctx, frame) < 0) {
-        std::cerr << "Couldn't get frame from buffersink: " << strerror(errno) << std::endl;
+    auto &converter = video_ctx->converter;
+    auto &frame = video_ctx->frame;
+    
+    if (!decode_frame(video_ctx)) {
         return false;
     }
     
     AVPixelFormat pix_fmt = correct_deprecated_format(codec_ctx->pix_fmt);
-    scaler_ctx = sws_getContext(frame->width, frame->height, pix_fmt,
-                                frame->width, frame->height, AV_PIX_FMT_RGB0, SWS_BILINEAR,
-                                NULL, NULL, NULL);
+    const uint8_t *crop_data[4];
     
-    if (!scaler_ctx) {
-        std::cout << "Could not allocate scaler" << std::endl;
+    if (video_ctx->tiled) {
+        for (int i=0; i!=4; i++) {
+            crop_data[i] = frame->data[i];
+        }
+    } else if (video_ctx->config.crop_mode == CROP_FILTER_GRAPH) {
+        if (av_buffersrc_add_frame(buffersrc_ctx, frame) < 0) {
+            std::cerr << "Couldn't add frame to buffersrc: " << strerror(errno) << std::endl;
+            return false;
+        }
+        
+        if (av_buffersink_get_frame(buffersink_ctx, frame) < 0) {
+            std::cerr << "Couldn't get frame from buffersink: " << strerror(errno) << std::endl;
+            return false;
+        }
+        
+        for (int i=0; i!=4; i++) {
+            crop_data[i] = frame->data[i];
+        }
+    } else if (!offset_planes(frame, pix_fmt, video_ctx->crop_x, video_ctx->crop_y, crop_data)) {
         return false;
     }
     
     *pts = frame->pts;
     
-    uint8_t *dst_buffer[4] = { frame_buffer, NULL, NULL, NULL };
-    int dst_linesize[4] = { frame->width * 4, 0, 0, 0 };
-    
-    sws_scale(scaler_ctx, frame->data, frame->linesize, 0, frame->height, dst_buffer, dst_linesize);
+    if (!converter->convert(crop_data, frame->linesize, video_ctx->width, video_ctx->height, pix_fmt, frame_buffer)) {
+        std::cerr << "Couldn't convert frame" << std::endl;
+        return false;
+    }
     
     return true;
 }
 
 void close_reader(VideoReaderContext *video_ctx) {
     
-    sws_freeContext(video_ctx->scaler_ctx);
+    video_ctx->packet_queue.abort();
+    
+    if (video_ctx->demux_thread.joinable()) {
+        video_ctx->demux_thread.join();
+    }
+    
+    video_ctx->packet_queue.clear();
+    
+    delete video_ctx->converter;
+    video_ctx->converter = nullptr;
     avformat_close_input(&video_ctx->format_ctx);
     avformat_free_context(video_ctx->format_ctx);
     avfilter_graph_free(&video_ctx->filter_graph);
     av_frame_free(&video_ctx->frame);
-    av_packet_free(&video_ctx->packet);
     avcodec_free_context(&video_ctx->codec_ctx);
 }
 
+void report_decode_fps(const char *filename, WallLayout layout, short position, int number_of_frames) {
+    
+    struct DecodeSetting {
+        const char *name;
+        int thread_count;
+        int thread_type;
+        bool low_delay;
+    };
+    
+    const DecodeSetting settings[] = {
+        { "single thread",        1, 0,                                  false },
+        { "slice",                0, FF_THREAD_SLICE,                    false },
+        { "frame",                0, FF_THREAD_FRAME,                    false },
+        { "frame + slice",        0, FF_THREAD_FRAME | FF_THREAD_SLICE,  false },
+        { "slice + low delay",    0, FF_THREAD_SLICE,                    true  },
+    };
+    
+    std::cout << "Decode FPS (" << number_of_frames << " frames):" << std::endl;
+    
+    for (const DecodeSetting &setting : settings) {
+        
+        VideoReaderContext video_ctx;
+        video_ctx.position = position;
+        video_ctx.layout = layout;
+        video_ctx.config.thread_count = setting.thread_count;
+        video_ctx.config.thread_type = setting.thread_type;
+        video_ctx.config.low_delay = setting.low_delay;
+        
+        if (!open_video_reader(filename, &video_ctx)) {
+            std::cerr << "Couldn't open video reader for " << setting.name << std::endl;
+            continue;
+        }
+        
+        int decoded_frames = 0;
+        auto start = std::chrono::steady_clock::now();
+        
+        while (decoded_frames != number_of_frames && decode_frame(&video_ctx)) {
+            decoded_frames++;
+        }
+        
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        
+        std::cout << "\t" << setting.name << " (" << video_ctx.codec_ctx->thread_count << " threads): " << decoded_frames / elapsed.count() << " FPS" << std::endl;
+        
+        close_reader(&video_ctx);
+    }
+}
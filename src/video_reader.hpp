@@ -9,6 +9,11 @@
 #define video_reader_hpp
 
 #include <iostream>
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 extern "C" {
     #include <libavcodec/avcodec.h>
@@ -19,13 +24,76 @@ extern "C" {
     #include <libavfilter/avfilter.h>
     #include <libavfilter/buffersrc.h>
     #include <libavfilter/buffersink.h>
+    #include <libavutil/pixdesc.h>
 }
 
+#include "color_converter.hpp"
+#include "wall_layout.hpp"
+
+enum CropMode {
+    // crop through a libavfilter graph (buffer -> crop -> buffersink)
+    CROP_FILTER_GRAPH,
+    // offset the plane pointers of the decoded frame, no copy
+    CROP_PLANE_OFFSET
+};
+
+enum SourceMode {
+    // decode the full wall video and crop the tile of this position
+    SOURCE_SPLIT,
+    // decode the pre-split tile of this position (see tile_splitter.cpp),
+    // falls back to SOURCE_SPLIT if the tile file doesn't exist
+    SOURCE_TILE
+};
+
+enum OutputFormat {
+    // converted to RGB0 on the CPU
+    OUTPUT_RGB0,
+    // planar YUV 4:2:0, converted to RGB by the yuv shader
+    OUTPUT_YUV420P
+};
+
+struct ReaderConfig {
+    // decoder threads, 0 lets libavcodec pick the number of cores
+    int thread_count = 0;
+    // FF_THREAD_FRAME and / or FF_THREAD_SLICE
+    int thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+    // libavcodec falls back to slice threading when low delay is requested
+    bool low_delay = false;
+    int conversion_threads = 0;
+    OutputFormat output_format = OUTPUT_RGB0;
+    CropMode crop_mode = CROP_PLANE_OFFSET;
+    SourceMode source_mode = SOURCE_TILE;
+    // packets read ahead by the demux thread
+    size_t packet_queue_size = 64;
+};
+
+// bounded queue between the demux thread and the decoder
+struct PacketQueue {
+    std::deque<AVPacket*> packets;
+    std::mutex mtx;
+    std::condition_variable cv;
+    size_t capacity = 64;
+    bool end_of_stream = false;
+    bool aborted = false;
+    
+    // blocks while full, false if the queue has been aborted
+    bool push(AVPacket* packet);
+    // blocks while empty, nullptr once the stream has ended
+    AVPacket* pop();
+    void finish();
+    void abort();
+    void clear();
+};
+
 struct VideoReaderContext {
     int width, height;
     short position;
+    WallLayout layout;
+    ReaderConfig config;
+    int crop_x, crop_y;
     int rgb_frame_size;
     AVRational time_base;
+    AVRational frame_rate;
     AVFormatContext* format_ctx;
     AVCodecContext* codec_ctx;
     AVCodecParameters* codec_params;
@@ -36,14 +104,21 @@ struct VideoReaderContext {
     AVFilterInOut* filter_inputs;
     AVFilterInOut* filter_outputs;
     AVFrame *frame;
-    AVPacket *packet;
-    SwsContext *scaler_ctx;
+    PacketQueue packet_queue;
+    std::thread demux_thread;
+    ColorConverter *converter = nullptr;
+    // opened file only holds the tile of this position, nothing to crop
+    bool tiled = false;
     bool end_of_file = false;
 };
 
 bool open_video_reader(const char *filename, VideoReaderContext *video_ctx);
+bool decode_frame(VideoReaderContext *video_ctx);
+bool offset_planes(AVFrame *frame, AVPixelFormat pix_fmt, int x, int y, const uint8_t *crop_data[4]);
 bool read_frame(VideoReaderContext *video_ctx, uint8_t *frame_buffer, int64_t *pts);
 void close_reader(VideoReaderContext *video_ctx);
+std::string get_tile_path(const char *filename, const WallLayout &layout, short position);
+void report_decode_fps(const char *filename, WallLayout layout, short position, int number_of_frames);
 
 #endif /* video_reader_hpp */
 
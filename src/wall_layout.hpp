@@ -0,0 +1,82 @@
+//
+//  wall_layout.hpp
+//  vibes
+//
+//  Created by Justus Stahlhut on 18.10.26.
+//
+
+#ifndef wall_layout_hpp
+#define wall_layout_hpp
+
+#include <cstdio>
+#include <cmath>
+#include <string>
+
+// rectangle of one display inside the wall video
+struct TileRect {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+};
+
+// columns x rows grid of displays, positions count row by row from the top left
+struct WallLayout {
+    int columns = 2;
+    int rows = 2;
+    
+    int get_number_of_positions() const {
+        return columns * rows;
+    }
+    
+    // tiles share one size, cut at even pixels so 4:2:0 chroma planes split cleanly,
+    // a remainder of the wall video on the right or bottom is dropped
+    TileRect get_tile(int position, int wall_width, int wall_height) const {
+        
+        TileRect tile;
+        tile.width = (wall_width / columns) & ~1;
+        tile.height = (wall_height / rows) & ~1;
+        tile.x = tile.width * (position % columns);
+        tile.y = tile.height * (position / columns);
+        
+        return tile;
+    }
+    
+    // "3x3" for columns x rows, a plain number of devices becomes the squarest grid (4 -> 2x2)
+    static bool parse(const char* description, WallLayout& layout) {
+        
+        int columns, rows;
+        char separator;
+        
+        if (std::sscanf(description, "%d%c%d", &columns, &separator, &rows) == 3 && (separator == 'x' || separator == 'X')) {
+            if (columns < 1 || rows < 1) {
+                return false;
+            }
+            
+            layout.columns = columns;
+            layout.rows = rows;
+            return true;
+        }
+        
+        int number_of_devices;
+        
+        if (std::sscanf(description, "%d", &number_of_devices) != 1 || number_of_devices < 1) {
+            return false;
+        }
+        
+        rows = (int) std::sqrt((double) number_of_devices);
+        while (number_of_devices % rows != 0) {
+            rows--;
+        }
+        
+        layout.columns = number_of_devices / rows;
+        layout.rows = rows;
+        return true;
+    }
+    
+    std::string to_string() const {
+        return std::to_string(columns) + "x" + std::to_string(rows);
+    }
+};
+
+#endif /* wall_layout_hpp */